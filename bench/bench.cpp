@@ -0,0 +1,221 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#define CLI11_ENABLE_EXTRA_VALIDATORS 1
+#include <CLI/CLI.hpp>
+
+#include "generator.hpp"
+#include "plans.hpp"
+#include "print.hpp"
+#include "snapshot.hpp"
+#include "toposort.hpp"
+#include "utils.hpp"
+
+namespace Toposort::Bench {
+    typedef uint32_t u32;
+    typedef uint64_t u64;
+    using std::string, std::vector, std::map, std::pair, std::cout, std::cerr, std::endl, std::ofstream, std::ifstream, std::filesystem::path;
+
+    //snapshot 为从编译好的快照读取同一份输入的耗时，与 load 对比；plans 为枚举出第一个备选学期安排的耗时
+    inline constexpr std::array<const char*, 6> phaseNames = { "load", "snapshot", "sort", "schedule", "render", "plans" };
+    //枚举备选学期安排每进入一个学期都要遍历全部课程，只在这个规模以内测量 plans
+    inline constexpr u32 planCourseLimit = 10000;
+
+    //超过 planCourseLimit 的规模没有测量 plans，不写入也不比较
+    [[nodiscard]] inline bool isMeasured(u32 courses, u64 phase) noexcept {
+        return phase != phaseNames.size() - 1 || courses <= planCourseLimit;
+    }
+
+    //同一规模重复多次取最短时间，单位为毫秒
+    struct Measurement {
+        u32 courses;
+        std::array<double, 6> milliseconds;
+    };
+
+    template<typename Task> [[nodiscard]] inline double timeIt(const Task& task) noexcept {
+        const auto start = std::chrono::steady_clock::now();
+        task();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    [[nodiscard]] inline bool measure(const GeneratorOptions& options, const path& inputFile, u32 repeat, Measurement& measurement, string& error) noexcept {
+        const string content = generateCurriculum(options);
+        {
+            ofstream file(inputFile, std::ios::out | std::ios::binary);
+            file << content;
+            if (!file) {
+                error = "无法写入临时文件：" + inputFile.string();
+                return false;
+            }
+        }
+        const path snapshotFile = path(inputFile).replace_extension(".tpsnap");
+        {
+            const Result<Curriculum> curriculum = parseCurriculum(content);
+            if (!curriculum.ok()) {
+                error = curriculum.error;
+                return false;
+            }
+            string snapshot;
+            writeSnapshot(snapshot, curriculum.value, hashContent(content), content.size());
+            if (!saveSnapshot(snapshotFile, snapshot, error)) return false;
+        }
+        measurement = { .courses = options.courses, .milliseconds = { 1e300, 1e300, 1e300, 1e300, 1e300, 1e300 } };
+        string buffer;
+        for (u32 i = 0; i < repeat; i++) {
+            Result<Curriculum> curriculum, restored;
+            Result<vector<vector<u32>>> arrangements;
+            Result<vector<Schedule>> schedules;
+            vector<vector<vector<u32>>> plans;
+            const std::array<double, 6> times = {
+                timeIt([&] { curriculum = loadInfoFromFile(inputFile.string()); }),
+                timeIt([&] { restored = loadCurriculum(snapshotFile.string(), ""); }),
+                curriculum.ok() ? timeIt([&] { arrangements = sortCourses(curriculum.value.courses, curriculum.value.graph, curriculum.value.semesterLimits); }) : 0,
+                arrangements.ok() && curriculum.ok() ? timeIt([&] { schedules = getSchedules(curriculum.value.courses, arrangements.value); }) : 0,
+                schedules.ok() && arrangements.ok() && curriculum.ok() ? timeIt([&] {
+                    buffer.clear();
+                    renderResult(buffer, OutputFormat::Text, curriculum.value.courses, arrangements.value, schedules.value);
+                }) : 0,
+                arrangements.ok() && curriculum.ok() && options.courses <= planCourseLimit ? timeIt([&] {
+                    PlanEnumerator enumerator(curriculum.value.courses, curriculum.value.graph, curriculum.value.semesterLimits);
+                    plans = firstPlans(enumerator, 1);
+                }) : 0,
+            };
+            if (arrangements.ok() && options.courses <= planCourseLimit && plans.empty()) error = "sortCourses 找到了学期安排，但没有枚举出任何备选学期安排。";
+            for (const string* message : { &curriculum.error, &restored.error, &arrangements.error, &schedules.error, &error }) if (!message->empty()) {
+                error = *message;
+                std::filesystem::remove(snapshotFile);
+                return false;
+            }
+            for (u64 phase = 0; phase < times.size(); phase++) measurement.milliseconds[phase] = std::min(measurement.milliseconds[phase], times[phase]);
+        }
+        std::filesystem::remove(snapshotFile);
+        return true;
+    }
+
+    //基准文件每行为：课程数,阶段,毫秒，其余行（如 # 开头的说明）被忽略
+    //毫秒是生成基准的那台机器上的绝对耗时，换机器或改构建类型后应在比较所用的机器上以同样的构建重新 --save
+    [[nodiscard]] inline map<pair<u32, string>, double> loadBaseline(const path& file) noexcept {
+        map<pair<u32, string>, double> baseline;
+        ifstream input(file);
+        string line;
+        while (std::getline(input, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            const u64 first = line.find(','), second = line.find(',', first + 1);
+            if (first == string::npos || second == string::npos) continue;
+            u32 courses;
+            if (!Utils::parseU32(string_view(line).substr(0, first), courses)) continue;
+            baseline[{ courses, line.substr(first + 1, second - first - 1) }] = std::strtod(line.c_str() + second + 1, nullptr);
+        }
+        return baseline;
+    }
+}
+
+int main(int argc, char** argv) {
+    typedef uint32_t u32;
+    typedef uint64_t u64;
+    using std::string, std::vector, std::cout, std::cerr, std::endl, std::ofstream, CLI::App, CLI::CallForHelp, CLI::ParseError, Toposort::Bench::GeneratorOptions, Toposort::Bench::Measurement, Toposort::Bench::phaseNames;
+
+    #if _TOPOSORT_WINDOWS
+        SetConsoleCP(CP_UTF8);
+        SetConsoleOutputCP(CP_UTF8);
+    #endif
+    App app;
+    app.name("toposort_bench");
+    app.allow_windows_style_options(false);
+    app.set_help_all_flag("");
+    app.set_help_flag("-h,--help", "输出这条帮助信息并退出。");
+    app.description("按不同规模生成培养方案，分别测量读取、学期安排、排课和输出的耗时；或只生成一份培养方案。");
+    GeneratorOptions options;
+    app.add_option("--width", options.width, "每学期的课程数。")->check(CLI::Range(1u, 50u));
+    app.add_option("--depth", options.depth, "最长先修链跨越的学期数。")->check(CLI::PositiveNumber);
+    app.add_option("--fan-in", options.fanIn, "每门课程最多的先修课程数。");
+    app.add_option("--pinned", options.pinnedShare, "指定学期的课程比例。")->check(CLI::Range(0.0, 1.0));
+    vector<double> creditWeights;
+    app.add_option("--credit-weights", creditWeights, "学时 1 到 6 的相对权重，例如 1 3 4 2 0 0。")->expected(6);
+    app.add_option("--semester-credits", options.semesterCredits, "每学期的学时上限。")->check(CLI::Range(6u, 50u));
+    app.add_option("--seed", options.seed, "随机数种子。");
+    string generateFile;
+    app.add_option("--generate", generateFile, "只生成一份培养方案写入该文件后退出，课程数由 --courses 指定。");
+    vector<u32> scales = { 100, 1000, 10000, 100000, 1000000 };
+    app.add_option("--courses", scales, "测量的课程数（可指定多个）。")->check(CLI::PositiveNumber);
+    u32 repeat = 3;
+    app.add_option("--repeat", repeat, "每个规模重复测量的次数，取最短时间。")->check(CLI::PositiveNumber);
+    string baselineFile, saveFile;
+    app.add_option("--baseline", baselineFile, "与该基准文件比较，有阶段变慢超过容差时以 1 退出；基准是绝对耗时，只应与同一台机器、同一构建类型生成的基准比较。")->check(CLI::ExistingFile);
+    app.add_option("--save", saveFile, "将本次结果保存为基准文件，换机器或构建类型后用它重新生成基准。");
+    double tolerance = 0.25, floorMs = 1.0;
+    app.add_option("--tolerance", tolerance, "允许的变慢比例。")->check(CLI::NonNegativeNumber);
+    app.add_option("--floor", floorMs, "低于该毫秒数的差异视为噪声。")->check(CLI::NonNegativeNumber);
+    try { app.parse(argc, argv); }
+    catch (const CallForHelp& e) {
+        cout << app.help("", CLI::AppFormatMode::All) << endl;
+        return 0;
+    }
+    catch (const ParseError& e) {
+        cerr << "参数错误：(" << e.get_exit_code() << ")" << e.get_name() << " " << e.what() << endl;
+        return 1;
+    }
+    if (!creditWeights.empty()) std::copy(creditWeights.begin(), creditWeights.end(), options.creditWeights.begin());
+    if (!generateFile.empty()) {
+        options.courses = scales.front();
+        ofstream file(generateFile, std::ios::out | std::ios::binary);
+        file << Toposort::Bench::generateCurriculum(options);
+        if (!file) {
+            cerr << "错误：无法写入文件：" << generateFile << endl;
+            return 1;
+        }
+        return 0;
+    }
+    const std::filesystem::path inputFile = std::filesystem::temp_directory_path() / "toposort_bench_input.txt";
+    vector<Measurement> measurements;
+    cout << std::setw(10) << "courses";
+    for (const char* phase : phaseNames) cout << std::setw(12) << phase;
+    cout << "   (ms)" << endl << std::fixed << std::setprecision(3);
+    for (const u32 courses : scales) {
+        options.courses = courses;
+        Measurement& measurement = measurements.emplace_back();
+        string error;
+        if (!Toposort::Bench::measure(options, inputFile, repeat, measurement, error)) {
+            cerr << "错误：" << courses << " 门课程：" << error << endl;
+            std::filesystem::remove(inputFile);
+            return 1;
+        }
+        cout << std::setw(10) << courses;
+        for (u64 phase = 0; phase < phaseNames.size(); phase++) {
+            if (Toposort::Bench::isMeasured(courses, phase)) cout << std::setw(12) << measurement.milliseconds[phase];
+            else cout << std::setw(12) << '-';
+        }
+        cout << endl;
+    }
+    std::filesystem::remove(inputFile);
+    if (!saveFile.empty()) {
+        ofstream file(saveFile, std::ios::out);
+        file << "# 课程数,阶段,毫秒；在用于比较的机器上以 Release 构建运行 toposort_bench --save <文件> 重新生成\n" << std::fixed << std::setprecision(3);
+        for (const Measurement& measurement : measurements) for (u64 phase = 0; phase < phaseNames.size(); phase++) if (Toposort::Bench::isMeasured(measurement.courses, phase)) file << measurement.courses << ',' << phaseNames[phase] << ',' << measurement.milliseconds[phase] << '\n';
+        if (!file) {
+            cerr << "错误：无法写入基准文件：" << saveFile << endl;
+            return 1;
+        }
+    }
+    if (baselineFile.empty()) return 0;
+    const auto baseline = Toposort::Bench::loadBaseline(baselineFile);
+    bool regressed = false;
+    for (const Measurement& measurement : measurements) for (u64 phase = 0; phase < phaseNames.size(); phase++) {
+        const auto it = baseline.find({ measurement.courses, phaseNames[phase] });
+        if (it == baseline.end()) continue;
+        const double current = measurement.milliseconds[phase], limit = std::max(it->second * (1 + tolerance), it->second + floorMs);
+        if (current > limit) {
+            cout << "变慢：" << measurement.courses << " 门课程的 " << phaseNames[phase] << " 阶段 " << it->second << " ms -> " << current << " ms" << endl;
+            regressed = true;
+        }
+    }
+    if (!regressed) cout << "与基准相比没有超出容差的变慢。" << endl;
+    return regressed ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+﻿#pragma once
+#include <algorithm>
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "toposort.hpp"
+
+namespace Toposort::Bench {
+    typedef uint32_t u32;
+    typedef uint64_t u64;
+    using std::array, std::string, std::vector, std::to_string;
+
+    struct GeneratorOptions {
+        u32 courses = 1000;
+        //每学期的课程数，即 DAG 每层的宽度
+        u32 width = 8;
+        //最长先修链跨越的学期数，先修课程只从同一段 depth 个学期中更早的学期选取
+        u32 depth = 8;
+        //每门课程的先修课程数在 0 到 fanIn 之间均匀分布（第一层除外）
+        u32 fanIn = 3;
+        //指定学期的课程比例
+        double pinnedShare = 0.1;
+        //学时 1 到 6 的相对权重
+        array<double, 6> creditWeights = { 1, 3, 4, 2, 0, 0 };
+        //每学期的学时上限，超出时改用 1 学时，保证贪心排课有余量
+        u32 semesterCredits = 30;
+        u64 seed = 1;
+    };
+
+    //先按学期填满课程再只从更早的学期选取先修课程，因此按文件顺序安排时总能得到完整的学期安排；
+    //课程按所在学期排列，生成的内容与输入文件格式相同
+    [[nodiscard]] inline string generateCurriculum(const GeneratorOptions& options) noexcept {
+        const u32 width = std::max<u32>(options.width, 1), depth = std::max<u32>(options.depth, 1);
+        u32 semesterCount = (options.courses + width - 1) / width;
+        semesterCount = std::max<u32>(semesterCount + (semesterCount & 1), 2);
+        std::mt19937_64 random(options.seed);
+        std::discrete_distribution<u32> creditDistribution(options.creditWeights.begin(), options.creditWeights.end());
+        std::bernoulli_distribution pinnedDistribution(std::clamp(options.pinnedShare, 0.0, 1.0));
+        std::uniform_int_distribution<u32> fanInDistribution(0, options.fanIn);
+        string result;
+        result.reserve(static_cast<u64>(options.courses) * 40 + semesterCount * 3);
+        vector<u32> firstCourse(semesterCount + 1, options.courses);
+        for (u32 semester = 0, course = 0; semester < semesterCount; semester++) {
+            const u32 count = std::min(width, options.courses - course);
+            firstCourse[semester] = course;
+            result += to_string(count);
+            result += semester + 1 < semesterCount ? ' ' : '\n';
+            course += count;
+        }
+        for (u32 semester = 0; semester < semesterCount; semester++) {
+            //先修课程的候选范围：本段的第一个学期到上一学期
+            const u32 blockStart = semester / depth * depth, candidateBegin = firstCourse[blockStart], candidateEnd = firstCourse[semester];
+            u32 credits = 0;
+            for (u32 course = firstCourse[semester]; course < firstCourse[semester + 1]; course++) {
+                u32 credit = creditDistribution(random) + 1;
+                if (credits + credit > options.semesterCredits) credit = 1;
+                credits += credit;
+                result += 'k';
+                result += to_string(course);
+                result += ",课程";
+                result += to_string(course);
+                result += ',';
+                result += to_string(credit);
+                result += ',';
+                result += pinnedDistribution(random) ? to_string(semester + 1) : "0";
+                result += ',';
+                if (candidateBegin < candidateEnd) {
+                    //至少一门先修课程来自上一学期，使先修链真正达到 depth 层
+                    const u32 fanIn = fanInDistribution(random);
+                    std::uniform_int_distribution<u32> previous(firstCourse[semester - 1], candidateEnd - 1), any(candidateBegin, candidateEnd - 1);
+                    for (u32 i = 0; i < fanIn; i++) {
+                        if (i > 0) result += ';';
+                        result += 'k';
+                        result += to_string(i == 0 ? previous(random) : any(random));
+                    }
+                }
+                result += '\n';
+            }
+        }
+        return result;
+    }
+}
\ No newline at end of file
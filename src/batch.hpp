@@ -0,0 +1,140 @@
+﻿#pragma once
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "diagnostics.hpp"
+#include "print.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
+#include "toposort.hpp"
+#include "utils.hpp"
+
+namespace Toposort {
+    using std::string, std::string_view, std::vector, std::ofstream, std::unordered_set, std::filesystem::path, std::filesystem::directory_iterator, Utils::MappedFile, Utils::Result;
+
+    struct RunOptions {
+        SchedulePriority priority = SchedulePriority::FileOrder;
+        PlacementOptions placement;
+        OutputFormat format = OutputFormat::Text;
+        //快照缓存目录，为空时不使用缓存
+        string cacheDirectory;
+    };
+
+    struct BatchItem {
+        path input, output;
+        string error;
+    };
+
+    //展开批量输入：目录取其中所有 .txt 文件（按路径排序），清单文件每行一个路径（相对于清单所在目录，忽略空行和 # 开头的行）
+    [[nodiscard]] inline Result<vector<path>> collectInputs(const vector<string>& inputs, const string& manifest) noexcept {
+        Result<vector<path>> result;
+        for (const string& input : inputs) {
+            std::error_code ec;
+            if (!std::filesystem::is_directory(input, ec)) {
+                result.value.emplace_back(input);
+                continue;
+            }
+            vector<path> files;
+            //operator++ 出错时会抛出异常，这里用 increment 逐项前进并检查 ec
+            for (directory_iterator it(input, ec); !ec && it != directory_iterator(); it.increment(ec)) {
+                std::error_code typeError;
+                if (it->is_regular_file(typeError) && it->path().extension() == ".txt") files.push_back(it->path());
+            }
+            if (ec) return { .error = "无法读取输入目录：" + input };
+            std::sort(files.begin(), files.end());
+            result.value.insert(result.value.end(), files.begin(), files.end());
+        }
+        if (!manifest.empty()) {
+            MappedFile file;
+            if (!file.open(manifest)) return { .error = "无法打开清单文件：" + manifest };
+            const string_view content = file.view();
+            const path base = path(manifest).parent_path();
+            string_view line;
+            for (u64 pos = 0; nextLine(content, pos, line);) {
+                while (!line.empty() && (line.back() == ' ' || line.back() == '\t')) line.remove_suffix(1);
+                while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) line.remove_prefix(1);
+                if (line.empty() || line.front() == '#') continue;
+                const path entry(std::u8string(line.begin(), line.end()));
+                result.value.push_back(entry.is_absolute() ? entry : base / entry);
+            }
+        }
+        if (result.value.empty()) return { .error = "没有指定任何输入文件。" };
+        return result;
+    }
+
+    [[nodiscard]] constexpr string_view getOutputExtension(OutputFormat format) noexcept {
+        switch (format) {
+            case OutputFormat::Json: return ".out.json";
+            case OutputFormat::Csv: return ".out.csv";
+            default: return ".out.txt";
+        }
+    }
+
+    //输出文件名为输入文件名加 .out.txt（或对应格式的扩展名），重名时依次追加序号
+    [[nodiscard]] inline vector<BatchItem> planBatch(const vector<path>& inputs, const path& outputDir, OutputFormat format = OutputFormat::Text) noexcept {
+        vector<BatchItem> items;
+        unordered_set<string> usedNames;
+        const string extension(getOutputExtension(format));
+        for (const path& input : inputs) {
+            const string stem = STR(input.stem());
+            string name = stem + extension;
+            for (u32 i = 2; !usedNames.insert(name).second; i++) name = stem + "-" + std::to_string(i) + extension;
+            items.push_back({ .input = input, .output = outputDir / std::u8string(name.begin(), name.end()), .error = {} });
+        }
+        return items;
+    }
+
+    //完整处理一个输入文件并写出结果，失败时将原因写入 error；buffer 仅作为可复用的输出缓冲区
+    [[nodiscard]] inline bool runFile(const path& input, const path& output, const RunOptions& options, string& buffer, string& error) noexcept {
+        const Result<Curriculum> curriculum = loadCurriculum(STR(input), options.cacheDirectory);
+        if (!curriculum.ok()) {
+            error = curriculum.error;
+            return false;
+        }
+        const vector<string> problems = diagnoseCurriculum(curriculum.value);
+        if (!problems.empty()) {
+            error.clear();
+            for (const string& problem : problems) error += (error.empty() ? "" : "\n") + problem;
+            return false;
+        }
+        const Result<vector<vector<u32>>> arrangements = sortCourses(curriculum.value.courses, curriculum.value.graph, curriculum.value.semesterLimits, options.priority);
+        if (!arrangements.ok()) {
+            error = arrangements.error;
+            return false;
+        }
+        const Result<vector<Schedule>> schedules = getSchedules(curriculum.value.courses, arrangements.value, options.placement);
+        if (!schedules.ok()) {
+            error = schedules.error;
+            return false;
+        }
+        Stats::Span renderSpan(Stats::Phase::Render);
+        buffer.clear();
+        renderResult(buffer, options.format, curriculum.value.courses, arrangements.value, schedules.value);
+        renderSpan.stop();
+        const Stats::Span writeSpan(Stats::Phase::Write);
+        ofstream file(output, std::ios::out);
+        if (!file.is_open()) {
+            error = "无法打开输出文件：" + string(STR(output));
+            return false;
+        }
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (!file) {
+            error = "无法写入输出文件：" + string(STR(output));
+            return false;
+        }
+        return true;
+    }
+
+    //用 threadCount 个线程（0 表示硬件并发数）并行处理所有输入，每个输入的错误记录在对应的 BatchItem 中
+    inline void runBatch(vector<BatchItem>& items, const RunOptions& options, u32 threadCount) noexcept {
+        Utils::parallelFor(items.size(), threadCount, [&](u64 i) noexcept {
+            thread_local string buffer;
+            (void)runFile(items[i].input, items[i].output, options, buffer, items[i].error);
+        });
+    }
+}
\ No newline at end of file
@@ -0,0 +1,236 @@
+﻿#pragma once
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "batch.hpp"
+#include "diagnostics.hpp"
+#include "print.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
+#include "toposort.hpp"
+#include "utils.hpp"
+
+namespace Toposort {
+    using std::string, std::string_view, std::vector, std::pair, std::ofstream, std::unordered_map, std::to_string, Utils::MappedFile, Utils::Result;
+
+    //多个队列（各自的培养方案）共用的教师或教室，同一时段最多同时供 capacity 次课使用；courses 为需要它的课程代码
+    struct Resource {
+        string name;
+        u32 capacity;
+        vector<string> courses;
+    };
+
+    //资源文件每行为：名称,容量,课程代码;课程代码…，忽略空行和 # 开头的行
+    [[nodiscard]] inline Result<vector<Resource>> parseResources(string_view content) noexcept {
+        Result<vector<Resource>> result;
+        string_view line, name, field, code;
+        for (u64 pos = 0, lineNumber = 1; nextLine(content, pos, line); lineNumber++) {
+            if (line.empty() || line.front() == '#') continue;
+            u64 linePos = 0;
+            u32 capacity;
+            if (!nextField(line, linePos, ',', name) || name.empty()) return { .error = "资源文件第 " + to_string(lineNumber) + " 行缺少资源名称。" };
+            if (!nextField(line, linePos, ',', field) || !parseU32(field, capacity) || capacity == 0) return { .error = "资源 " + string(name) + " 的容量无效。" };
+            Resource& resource = result.value.emplace_back(string(name), capacity, vector<string>());
+            if (linePos >= line.size()) continue;
+            field = line.substr(linePos);
+            for (u64 codePos = 0; nextField(field, codePos, ';', code);) if (!code.empty()) resource.courses.emplace_back(code);
+        }
+        return result;
+    }
+
+    [[nodiscard]] inline Result<vector<Resource>> loadResources(const string& file) noexcept {
+        MappedFile mapped;
+        if (!mapped.open(file)) return { .error = "无法打开资源文件：" + file };
+        return parseResources(mapped.view());
+    }
+
+    //各资源在一个学期中的占用情况。容量为 c 的资源用 c 层时段位图计数：第 k 层为至少被占用 k + 1 次的时段，
+    //占用时逐层进位，最上一层即已满的时段，因此冲突检查只需一次按位与
+    class ResourceOccupancy {
+        vector<u32> offsets;
+        vector<u64> layers;
+
+    public:
+        //layerCounts[i] 为资源 i 需要的层数，为 0 时资源永远不会占满
+        [[nodiscard]] explicit ResourceOccupancy(const vector<u32>& layerCounts) noexcept : offsets(layerCounts.size() + 1, 0) {
+            for (u64 i = 0; i < layerCounts.size(); i++) offsets[i + 1] = offsets[i] + layerCounts[i];
+            layers.assign(offsets.back(), 0);
+        }
+
+        [[nodiscard]] u64 getFull(u32 resource) const noexcept { return offsets[resource] == offsets[resource + 1] ? 0 : layers[offsets[resource + 1] - 1]; }
+
+        //调用方保证 mask 与 getFull(resource) 不相交
+        void occupy(u32 resource, u64 mask) noexcept {
+            for (u32 i = offsets[resource]; i < offsets[resource + 1] && mask != 0; i++) {
+                const u64 carry = layers[i] & mask;
+                layers[i] |= mask;
+                mask = carry;
+            }
+        }
+    };
+
+    //一个队列：semesters[i] 为第 i + 1 学期的课程（可能为空），各队列的同一学期在同一周课表上统一排课
+    struct Cohort {
+        string name;
+        Curriculum curriculum;
+        vector<vector<u32>> semesters;
+    };
+
+    //在共用的 5 × 10 周课表上为所有队列排课：每个队列的各次课互不重叠，每个资源在任何时段的占用不超过容量。
+    //同一学期内先放置需要资源的课程，再按队列和课程顺序放置其余课程；各学期互不影响，threadCount 不为 1 时并行处理。
+    //结果中 [k][i] 为队列 k 第 i + 1 学期的课表；失败时按学期顺序逐行报告每门放不下的课程，以及占满相关资源的队列
+    [[nodiscard]] inline Result<vector<vector<Schedule>>> placeCohorts(const vector<Cohort>& cohorts, const vector<Resource>& resources, u32 threadCount = 1) noexcept {
+        constexpr u32 days = Schedule::days, slots = Schedule::slotsPerDay;
+        const Stats::Span span(Stats::Phase::Place);
+        Result<vector<vector<Schedule>>> result;
+        const u32 cohortCount = static_cast<u32>(cohorts.size());
+        u64 semesterCount = 0;
+        for (const Cohort& cohort : cohorts) semesterCount = std::max<u64>(semesterCount, cohort.semesters.size());
+        Stats::add(Stats::Counter::Semesters, semesterCount);
+        //每个队列的一次课不会与自己重叠，同一时段最多占用 cohortCount 次，容量不小于它的资源不需要计数
+        vector<u32> layerCounts(resources.size());
+        for (u64 i = 0; i < resources.size(); i++) layerCounts[i] = std::min(resources[i].capacity, cohortCount);
+        unordered_map<string_view, vector<u32>> codeResources;
+        for (u32 i = 0; i < resources.size(); i++) for (const string& code : resources[i].courses) {
+            vector<u32>& ids = codeResources[code];
+            if (std::find(ids.begin(), ids.end(), i) == ids.end()) ids.push_back(i);
+        }
+        //courseResources[k] 为队列 k 中各课程需要的资源，按课程编号以 CSR 形式保存
+        vector<pair<vector<u32>, vector<u32>>> courseResources(cohortCount);
+        for (u32 k = 0; k < cohortCount; k++) {
+            const vector<Course>& courses = cohorts[k].curriculum.courses;
+            auto& [offsets, ids] = courseResources[k];
+            offsets.assign(courses.size() + 1, 0);
+            for (u64 i = 0; i < courses.size(); i++) {
+                const auto it = codeResources.find(courses[i].code);
+                if (it != codeResources.end()) ids.insert(ids.end(), it->second.begin(), it->second.end());
+                offsets[i + 1] = static_cast<u32>(ids.size());
+            }
+        }
+        result.value.resize(cohortCount);
+        for (u32 k = 0; k < cohortCount; k++) result.value[k].resize(cohorts[k].semesters.size());
+        vector<string> errors(semesterCount);
+        Utils::parallelFor(semesterCount, threadCount, [&](u64 semester) noexcept {
+            string& error = errors[semester];
+            const auto fail = [&](const string& message) noexcept { error += (error.empty() ? "" : "\n") + ("第 " + to_string(semester + 1) + " 学期：" + message); };
+            ResourceOccupancy occupancy(layerCounts);
+            vector<u64> cohortUsed(cohortCount, 0);
+            //每个资源被哪些队列占用了哪些时段，只在报告冲突时查询
+            vector<vector<pair<u32, u64>>> holders(resources.size());
+            //（队列，课程在该学期安排中的下标），需要资源的课程在前
+            vector<pair<u32, u32>> order;
+            for (u32 pass = 0; pass < 2; pass++) for (u32 k = 0; k < cohortCount; k++) {
+                if (semester >= cohorts[k].semesters.size()) continue;
+                const vector<u32>& arrangement = cohorts[k].semesters[semester];
+                const vector<u32>& offsets = courseResources[k].first;
+                for (u32 i = 0; i < arrangement.size(); i++) if ((offsets[arrangement[i] + 1] != offsets[arrangement[i]]) == (pass == 0)) order.emplace_back(k, i);
+            }
+            for (u32 k = 0; k < cohortCount; k++) if (semester < cohorts[k].semesters.size() && cohorts[k].semesters[semester].size() >= Schedule::emptySlot) fail("队列 " + cohorts[k].name + " 的课程数量超过了课表的容量。");
+            for (const auto& [k, i] : order) {
+                const vector<Course>& courses = cohorts[k].curriculum.courses;
+                const vector<u32>& arrangement = cohorts[k].semesters[semester];
+                if (arrangement.size() >= Schedule::emptySlot) continue;
+                const CourseSlot slot = getCourseSlot(courses, arrangement[i]);
+                const vector<u32>& offsets = courseResources[k].first;
+                const vector<u32>& ids = courseResources[k].second;
+                //本队列已占用的时段与任一所需资源已满的时段都不可用；之后放下的时段随即计入本队列，因此整门课程只需计算一次
+                u64 resourceFull = 0;
+                for (u32 j = offsets[slot.course]; j < offsets[slot.course + 1]; j++) resourceFull |= occupancy.getFull(ids[j]);
+                u32 blockedDays = 0;
+                for (u32 session = 0; session < slot.sessionsPerWeek; session++) {
+                    const u32 length = slot.sessionLengths[session];
+                    u32 day = 0, startSlot = 0;
+                    if (!findPlacement<days, slots>(cohortUsed[k] | resourceFull, blockedDays, length, day, startSlot)) {
+                        const Course& course = courses[slot.course];
+                        const string label = "队列 " + cohorts[k].name + " 的课程 " + string(course.code) + "（" + string(course.name) + "）";
+                        //本队列还能放下这次课的所有时段，若存在则是资源冲突
+                        u64 open = 0;
+                        for (u32 d = 0; d < days; d++) for (u32 s = 0; s + length <= slots; s++) if (canPlace<slots>(cohortUsed[k], d, s, length)) open |= getSlotMask<slots>(d, s, length);
+                        if (open == 0) {
+                            fail("无法为" + label + "安排足够的课时。");
+                            break;
+                        }
+                        string blockers;
+                        for (u32 j = offsets[slot.course]; j < offsets[slot.course + 1]; j++) {
+                            const u32 resource = ids[j];
+                            if ((occupancy.getFull(resource) & open) == 0) continue;
+                            vector<u32> holderCohorts;
+                            for (const auto& [holder, mask] : holders[resource]) if ((mask & open) != 0 && std::find(holderCohorts.begin(), holderCohorts.end(), holder) == holderCohorts.end()) holderCohorts.push_back(holder);
+                            string names;
+                            for (u64 h = 0; h < holderCohorts.size() && h < 5; h++) names += (h > 0 ? "、" : "") + cohorts[holderCohorts[h]].name;
+                            if (holderCohorts.size() > 5) names += " 等 " + to_string(holderCohorts.size()) + " 个队列";
+                            blockers += (blockers.empty() ? "" : "；") + ("资源 " + resources[resource].name + "（容量 " + to_string(resources[resource].capacity) + "）已被 " + names + " 占满");
+                        }
+                        fail(label + "无法排入课表：本队列空闲的时段中，" + blockers + "。");
+                        break;
+                    }
+                    const u64 mask = getSlotMask<slots>(day, startSlot, length);
+                    place(result.value[k][semester], cohortUsed[k], day, startSlot, length, static_cast<u8>(i));
+                    for (u32 j = offsets[slot.course]; j < offsets[slot.course + 1]; j++) {
+                        occupancy.occupy(ids[j], mask);
+                        holders[ids[j]].emplace_back(k, mask);
+                    }
+                    blockedDays = getBlockedDays(blockedDays, day);
+                }
+            }
+        });
+        for (const string& error : errors) if (!error.empty()) result.error += (result.error.empty() ? "" : "\n") + error;
+        if (!result.ok()) result.value.clear();
+        return result;
+    }
+
+    //将每个输入作为一个队列统一排课，各自写出到对应的输出文件，写出失败的原因记录在对应的 BatchItem 中。
+    //任何队列读取、检查或学期安排失败，或者统一排课失败时，返回 false 并将原因写入 error（每行一条），不写出任何文件
+    [[nodiscard]] inline bool runCohorts(vector<BatchItem>& items, const vector<Resource>& resources, const RunOptions& options, u32 threadCount, string& error) noexcept {
+        vector<Cohort> cohorts(items.size());
+        Utils::parallelFor(items.size(), threadCount, [&](u64 i) noexcept {
+            Cohort& cohort = cohorts[i];
+            cohort.name = STR(items[i].input.stem());
+            Result<Curriculum> curriculum = loadCurriculum(STR(items[i].input), options.cacheDirectory);
+            if (!curriculum.ok()) {
+                items[i].error = curriculum.error;
+                return;
+            }
+            cohort.curriculum = move(curriculum.value);
+            const vector<string> problems = diagnoseCurriculum(cohort.curriculum);
+            for (const string& problem : problems) items[i].error += (items[i].error.empty() ? "" : "\n") + problem;
+            if (!problems.empty()) return;
+            SemesterPlan plan;
+            if (!checkSemesterBounds(cohort.curriculum.courses, cohort.curriculum.graph, cohort.curriculum.semesterLimits, items[i].error)) return;
+            if (!planSemesters(cohort.curriculum.courses, cohort.curriculum.graph, cohort.curriculum.semesterLimits, options.priority, 0, plan, items[i].error)) return;
+            cohort.semesters = move(plan.semesters);
+        });
+        error.clear();
+        for (BatchItem& item : items) if (!item.error.empty()) {
+            error += (error.empty() ? "" : "\n") + string(STR(item.input)) + "：" + item.error;
+            item.error.clear();
+        }
+        if (!error.empty()) return false;
+        const Result<vector<vector<Schedule>>> schedules = placeCohorts(cohorts, resources, threadCount);
+        if (!schedules.ok()) {
+            error = schedules.error;
+            return false;
+        }
+        //各队列的学期序号表示同一个学期，因此与 sortCourses 不同，没有课程的学期也保留在输出中
+        Utils::parallelFor(items.size(), threadCount, [&](u64 i) noexcept {
+            Stats::Span renderSpan(Stats::Phase::Render);
+            string buffer;
+            renderResult(buffer, options.format, cohorts[i].curriculum.courses, cohorts[i].semesters, schedules.value[i]);
+            renderSpan.stop();
+            const Stats::Span writeSpan(Stats::Phase::Write);
+            ofstream file(items[i].output, std::ios::out);
+            if (!file.is_open()) {
+                items[i].error = "无法打开输出文件：" + string(STR(items[i].output));
+                return;
+            }
+            file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            if (!file) items[i].error = "无法写入输出文件：" + string(STR(items[i].output));
+        });
+        return true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+﻿#pragma once
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "stats.hpp"
+#include "toposort.hpp"
+
+namespace Toposort {
+    using std::string, std::vector, std::pair, std::queue, std::to_string;
+
+    //Tarjan 算法求强连通分量（迭代实现，避免长先修链导致栈溢出），component[i] 为课程 i 所在分量的编号
+    [[nodiscard]] inline u32 findComponents(const CourseGraph& graph, vector<u32>& component) noexcept {
+        const u32 courseCount = graph.size();
+        vector<u32> index(courseCount, UINT32_MAX), lowLink(courseCount, 0), stack;
+        vector<bool> onStack(courseCount, false);
+        //（课程编号，下一条待访问的边）
+        vector<pair<u32, u32>> callStack;
+        component.assign(courseCount, UINT32_MAX);
+        u32 nextIndex = 0, componentCount = 0;
+        const auto visit = [&](u32 course) noexcept {
+            index[course] = lowLink[course] = nextIndex++;
+            stack.push_back(course);
+            onStack[course] = true;
+            callStack.emplace_back(course, graph.offsets[course]);
+        };
+        for (u32 root = 0; root < courseCount; root++) {
+            if (index[root] != UINT32_MAX) continue;
+            visit(root);
+            while (!callStack.empty()) {
+                const u32 course = callStack.back().first, edge = callStack.back().second;
+                if (edge < graph.offsets[course + 1]) {
+                    callStack.back().second++;
+                    const u32 next = graph.dependents[edge];
+                    if (index[next] == UINT32_MAX) visit(next);
+                    else if (onStack[next]) lowLink[course] = std::min(lowLink[course], index[next]);
+                    continue;
+                }
+                if (lowLink[course] == index[course]) {
+                    u32 member;
+                    do {
+                        member = stack.back();
+                        stack.pop_back();
+                        onStack[member] = false;
+                        component[member] = componentCount;
+                    } while (member != course);
+                    componentCount++;
+                }
+                callStack.pop_back();
+                if (!callStack.empty()) lowLink[callStack.back().first] = std::min(lowLink[callStack.back().first], lowLink[course]);
+            }
+        }
+        return componentCount;
+    }
+
+    //在分量内从 start 出发广度优先搜索回到 start 的最短环，返回环上的课程（首尾相同）
+    [[nodiscard]] inline vector<u32> findCycle(const CourseGraph& graph, const vector<u32>& component, u32 start, vector<u32>& parent) noexcept {
+        queue<u32> pending;
+        pending.push(start);
+        parent[start] = start;
+        vector<u32> visited = { start }, cycle;
+        u32 last = UINT32_MAX;
+        while (!pending.empty() && last == UINT32_MAX) {
+            const u32 course = pending.front();
+            pending.pop();
+            for (u32 i = graph.offsets[course]; i < graph.offsets[course + 1]; i++) {
+                const u32 next = graph.dependents[i];
+                if (next == start) {
+                    last = course;
+                    break;
+                }
+                if (component[next] != component[start] || parent[next] != UINT32_MAX) continue;
+                parent[next] = course;
+                visited.push_back(next);
+                pending.push(next);
+            }
+        }
+        cycle.push_back(start);
+        for (u32 course = last; course != start; course = parent[course]) cycle.push_back(course);
+        cycle.push_back(start);
+        std::reverse(cycle.begin() + 1, cycle.end() - 1);
+        for (const u32 course : visited) parent[course] = UINT32_MAX;
+        return cycle;
+    }
+
+    //排课前一次找出所有先修关系问题：不存在的先修课程，以及先修关系中的每个环；没有问题时返回空列表
+    [[nodiscard]] inline vector<string> diagnoseCurriculum(const Curriculum& curriculum) noexcept {
+        const Stats::Span span(Stats::Phase::Analyze);
+        const vector<Course>& courses = curriculum.courses;
+        const CourseGraph& graph = curriculum.graph;
+        vector<string> problems;
+        for (const auto& [course, prerequisite] : graph.danglingReferences) {
+            problems.push_back("课程 " + string(courses[course].code) + "（" + string(courses[course].name) + "）的先修课程 " + string(courses[course].prerequisites[prerequisite]) + " 不存在。");
+        }
+        vector<u32> component;
+        const u32 componentCount = findComponents(graph, component);
+        if (componentCount == graph.size()) {
+            //每个分量只有一门课程时，只有自环才构成环
+            bool selfLoop = false;
+            for (u32 i = 0; i < graph.size() && !selfLoop; i++) for (u32 j = graph.offsets[i]; j < graph.offsets[i + 1]; j++) selfLoop |= graph.dependents[j] == i;
+            if (!selfLoop) return problems;
+        }
+        vector<u32> componentSize(componentCount, 0), parent(graph.size(), UINT32_MAX);
+        for (const u32 id : component) componentSize[id]++;
+        vector<bool> reported(componentCount, false), blocked(graph.size(), false);
+        queue<u32> pending;
+        for (u32 i = 0; i < graph.size(); i++) {
+            const u32 id = component[i];
+            if (reported[id]) continue;
+            bool cyclic = componentSize[id] > 1;
+            for (u32 j = graph.offsets[i]; j < graph.offsets[i + 1] && !cyclic; j++) cyclic = graph.dependents[j] == i;
+            if (!cyclic) continue;
+            reported[id] = true;
+            //只列出环上的前 20 门课程
+            const vector<u32> cycle = findCycle(graph, component, i, parent);
+            string message = "先修关系存在环：";
+            for (u64 j = 0; j < cycle.size(); j++) {
+                if (j == 20 && cycle.size() > 21) {
+                    message += " → …（共 " + to_string(cycle.size() - 1) + " 门课程） → ";
+                    message += courses[i].code;
+                    break;
+                }
+                if (j > 0) message += " → ";
+                message += courses[cycle[j]].code;
+            }
+            if (componentSize[id] > cycle.size() - 1) message += "，与之相互依赖的课程共 " + to_string(componentSize[id]) + " 门";
+            problems.push_back(message + "。");
+        }
+        for (u32 i = 0; i < graph.size(); i++) if (reported[component[i]]) {
+            blocked[i] = true;
+            pending.push(i);
+        }
+        //依赖于环的课程同样无法安排，只报告数量
+        u32 blockedCount = 0;
+        while (!pending.empty()) {
+            const u32 course = pending.front();
+            pending.pop();
+            for (u32 i = graph.offsets[course]; i < graph.offsets[course + 1]; i++) if (!blocked[graph.dependents[i]]) {
+                blocked[graph.dependents[i]] = true;
+                blockedCount++;
+                pending.push(graph.dependents[i]);
+            }
+        }
+        if (blockedCount > 0) problems.push_back("另有 " + to_string(blockedCount) + " 门课程直接或间接以上述环中的课程为先修课程，同样无法安排。");
+        return problems;
+    }
+}
\ No newline at end of file
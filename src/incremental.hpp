@@ -0,0 +1,241 @@
+﻿#pragma once
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "toposort.hpp"
+#include "utils.hpp"
+
+namespace Toposort {
+    using std::string, std::string_view, std::vector, std::unordered_map, std::move, Utils::Result;
+
+    //在内存中保存先修关系图、逐学期安排和各学期课表，修改培养方案后只重算受影响的学期；
+    //结果与对修改后的数据完整执行 sortCourses、getSchedules 相同
+    class IncrementalPlanner {
+        Curriculum curriculum;
+        SchedulePriority priority;
+        PlacementOptions options;
+        u32 threadCount;
+        //字符串池与构造时传入的方案共享，第一次存入新文本时才换成自己的池
+        bool ownsStrings = false;
+        //与 buildCourseGraph 一致，重复的课程代码以最后一门为准
+        unordered_map<string_view, u32> courseIndex;
+        SemesterPlan plan;
+        string planError;
+        //从该学期起需要重新安排，UINT32_MAX 表示安排是最新的
+        u64 dirtySemester = 0;
+        //每个学期上次排课时的课程、在结果中的序号及结果，课程与序号都不变时沿用
+        vector<vector<u32>> scheduledCourses;
+        vector<u64> scheduledIndices;
+        vector<Schedule> semesterSchedules;
+        vector<string> scheduleErrors;
+        Result<vector<vector<u32>>> arrangementResult;
+        Result<vector<Schedule>> scheduleResult;
+        bool schedulesDirty = true;
+
+        [[nodiscard]] u32 findCourse(string_view code) const noexcept {
+            const auto it = courseIndex.find(code);
+            return it == courseIndex.end() ? UINT32_MAX : it->second;
+        }
+
+        //按旧的安排计算课程最早可以开始安排的学期，先修课程尚未安排时为 UINT32_MAX
+        [[nodiscard]] u64 getReadySemester(u32 course) const noexcept {
+            u64 semester = 0;
+            for (const string_view prerequisite : curriculum.courses[course].prerequisites) {
+                const u32 id = findCourse(prerequisite);
+                if (id == UINT32_MAX) continue;
+                if (id >= plan.semesterOf.size() || plan.semesterOf[id] == UINT32_MAX) return UINT32_MAX;
+                semester = std::max<u64>(semester, plan.semesterOf[id] + 1);
+            }
+            return semester;
+        }
+
+        //课程的状态只在它可以安排之后才会影响结果，因此修改前后可安排学期中较早的一个之前的安排不变；
+        //始终无法安排的课程仍会影响最后的出错信息，此时只需重做最后的检查
+        void markCourse(u32 course, u64 readyBefore) noexcept {
+            const u64 semester = std::min(readyBefore, getReadySemester(course));
+            dirtySemester = std::min(dirtySemester, semester == UINT32_MAX ? plan.semesters.size() : semester);
+        }
+
+        //把修改中的文本存入自己的池，原方案的池不随修改增长
+        [[nodiscard]] string_view store(string_view text) noexcept {
+            if (!ownsStrings) {
+                curriculum.strings = std::make_shared<Utils::StringPool>(move(curriculum.strings));
+                ownsStrings = true;
+            }
+            return curriculum.strings->store(text);
+        }
+
+        void rebuildGraph() noexcept {
+            buildCourseGraph(curriculum.courses, curriculum.graph);
+        }
+
+        void updatePlan() noexcept {
+            if (dirtySemester == UINT32_MAX) return;
+            planError.clear();
+            schedulesDirty = true;
+            //与 sortCourses 一样先检查必要条件；不满足时保留原来的安排与需要重算的学期
+            if (!checkSemesterBounds(curriculum.courses, curriculum.graph, curriculum.semesterLimits, planError)) {
+                arrangementResult = { .error = planError };
+                return;
+            }
+            (void)planSemesters(curriculum.courses, curriculum.graph, curriculum.semesterLimits, priority, std::min<u64>(dirtySemester, plan.semesters.size()), plan, planError);
+            dirtySemester = UINT32_MAX;
+            arrangementResult = { .error = planError };
+            if (planError.empty()) for (const vector<u32>& arrangement : plan.semesters) if (!arrangement.empty()) arrangementResult.value.push_back(arrangement);
+        }
+
+        void updateSchedules() noexcept {
+            updatePlan();
+            if (!schedulesDirty) return;
+            schedulesDirty = false;
+            scheduleResult = {};
+            if (!arrangementResult.ok()) {
+                scheduleResult.error = arrangementResult.error;
+                return;
+            }
+            const vector<vector<u32>>& arrangements = arrangementResult.value;
+            const u64 semesterCount = plan.semesters.size();
+            scheduledCourses.resize(semesterCount);
+            scheduledIndices.resize(semesterCount, UINT64_MAX);
+            semesterSchedules.resize(semesterCount);
+            scheduleErrors.resize(semesterCount);
+            //出错信息中含有学期序号，因此失败的学期在序号变化时也要重算
+            vector<u64> pending;
+            for (u64 semester = 0, index = 0; semester < semesterCount; semester++) {
+                if (plan.semesters[semester].empty()) continue;
+                if (scheduledCourses[semester] != plan.semesters[semester] || (!scheduleErrors[semester].empty() && scheduledIndices[semester] != index)) pending.push_back(semester);
+                scheduledIndices[semester] = index++;
+            }
+            const auto reschedule = [&](u64 semester, vector<CourseSlot>& courseSlots) noexcept {
+                semesterSchedules[semester] = Schedule();
+                scheduleErrors[semester].clear();
+                scheduledCourses[semester] = plan.semesters[semester];
+                return getSchedule(curriculum.courses, plan.semesters[semester], scheduledIndices[semester], options, courseSlots, semesterSchedules[semester], scheduleErrors[semester]);
+            };
+            if (threadCount == 1 || arrangements.size() == 1) {
+                //与串行的 getSchedules 一样在第一个失败的学期停止
+                vector<CourseSlot> courseSlots;
+                for (u64 i = 0, semester = 0; semester < semesterCount; semester++) {
+                    if (plan.semesters[semester].empty()) continue;
+                    if (i < pending.size() && pending[i] == semester) {
+                        i++;
+                        if (!reschedule(semester, courseSlots)) {
+                            //后续学期未被重算，记录为过期
+                            for (; i < pending.size(); i++) scheduledCourses[pending[i]].clear();
+                        }
+                    }
+                    if (!scheduleErrors[semester].empty()) {
+                        scheduleResult = { .error = scheduleErrors[semester] };
+                        return;
+                    }
+                    scheduleResult.value.push_back(semesterSchedules[semester]);
+                }
+                return;
+            }
+            Utils::parallelFor(pending.size(), threadCount, [&](u64 i) noexcept {
+                thread_local vector<CourseSlot> courseSlots;
+                (void)reschedule(pending[i], courseSlots);
+            });
+            for (u64 semester = 0; semester < semesterCount; semester++) {
+                if (plan.semesters[semester].empty()) continue;
+                const string& error = scheduleErrors[semester];
+                if (!error.empty()) scheduleResult.error += (scheduleResult.error.empty() ? "" : "\n") + error;
+                scheduleResult.value.push_back(semesterSchedules[semester]);
+            }
+            if (!scheduleResult.ok()) scheduleResult.value.clear();
+        }
+
+    public:
+        [[nodiscard]] explicit IncrementalPlanner(Curriculum curriculum, SchedulePriority priority = SchedulePriority::FileOrder, const PlacementOptions& options = {}, u32 threadCount = 1) noexcept
+            : curriculum(move(curriculum)), priority(priority), options(options), threadCount(threadCount) {
+            courseIndex.reserve(this->curriculum.courses.size());
+            for (u32 i = 0; i < this->curriculum.courses.size(); i++) courseIndex[this->curriculum.courses[i].code] = i;
+        }
+
+        [[nodiscard]] const Curriculum& getCurriculum() const noexcept { return curriculum; }
+
+        //追加一门课程，返回其编号；已有课程的先修代码可能因此指向新课程。课程的各个字段会复制到本对象的字符串池中
+        [[nodiscard]] Result<u32> addCourse(Course course) noexcept {
+            if (course.credit == 0) return { .error = "课程 " + string(course.code) + "（" + string(course.name) + "）的学时不能为零。" };
+            for (const string_view prerequisite : course.prerequisites) if (prerequisite.empty()) return { .error = "课程 " + string(course.code) + "（" + string(course.name) + "）的先修课程列表格式错误。" };
+            course.name = store(course.name);
+            course.code = store(course.code);
+            for (string_view& prerequisite : course.prerequisites) prerequisite = store(prerequisite);
+            vector<u32> referrers;
+            vector<u64> readyBefore;
+            for (u32 i = 0; i < curriculum.courses.size(); i++) if (std::find(curriculum.courses[i].prerequisites.begin(), curriculum.courses[i].prerequisites.end(), course.code) != curriculum.courses[i].prerequisites.end()) {
+                referrers.push_back(i);
+                readyBefore.push_back(getReadySemester(i));
+            }
+            //同代码的旧课程失去后续课程，其优先级可能变化
+            touchPrerequisite(course.code);
+            const u32 id = static_cast<u32>(curriculum.courses.size());
+            courseIndex[course.code] = id;
+            curriculum.courses.push_back(move(course));
+            rebuildGraph();
+            markCourse(id, UINT32_MAX);
+            for (u64 i = 0; i < referrers.size(); i++) markCourse(referrers[i], readyBefore[i]);
+            for (const string_view prerequisite : curriculum.courses[id].prerequisites) touchPrerequisite(prerequisite);
+            return { .value = id, .error = {} };
+        }
+
+        //为课程 code 增加先修课程 prerequisite，返回被修改课程的编号
+        [[nodiscard]] Result<u32> addPrerequisite(string_view code, string_view prerequisite) noexcept {
+            const u32 id = findCourse(code);
+            if (id == UINT32_MAX) return { .error = "找不到课程 " + string(code) + "。" };
+            if (prerequisite.empty()) return { .error = "先修课程代码不能为空。" };
+            const u64 readyBefore = getReadySemester(id);
+            curriculum.courses[id].prerequisites.push_back(store(prerequisite));
+            touchPrerequisite(prerequisite);
+            rebuildGraph();
+            markCourse(id, readyBefore);
+            return { .value = id, .error = {} };
+        }
+
+        //删除课程 code 的先修课程 prerequisite（若重复出现则全部删除），返回被修改课程的编号
+        [[nodiscard]] Result<u32> removePrerequisite(string_view code, string_view prerequisite) noexcept {
+            const u32 id = findCourse(code);
+            if (id == UINT32_MAX) return { .error = "找不到课程 " + string(code) + "。" };
+            vector<string_view>& prerequisites = curriculum.courses[id].prerequisites;
+            if (std::find(prerequisites.begin(), prerequisites.end(), prerequisite) == prerequisites.end()) return { .error = "课程 " + string(code) + " 没有先修课程 " + string(prerequisite) + "。" };
+            const u64 readyBefore = getReadySemester(id);
+            touchPrerequisite(prerequisite);
+            std::erase(prerequisites, prerequisite);
+            rebuildGraph();
+            markCourse(id, readyBefore);
+            return { .value = id, .error = {} };
+        }
+
+        //将课程 code 指定到第 semester 学期，0 表示取消指定，返回被修改课程的编号
+        [[nodiscard]] Result<u32> pinCourse(string_view code, u32 semester) noexcept {
+            const u32 id = findCourse(code);
+            if (id == UINT32_MAX) return { .error = "找不到课程 " + string(code) + "。" };
+            curriculum.courses[id].semester = semester;
+            markCourse(id, UINT32_MAX);
+            return { .value = id, .error = {} };
+        }
+
+        [[nodiscard]] const Result<vector<vector<u32>>>& getArrangements() noexcept {
+            updatePlan();
+            return arrangementResult;
+        }
+
+        [[nodiscard]] const Result<vector<Schedule>>& getSchedules() noexcept {
+            updateSchedules();
+            return scheduleResult;
+        }
+
+    private:
+        //按后续课程数排序时，先修课程的优先级随先修关系变化；按关键路径排序时所有先修课程的名次都可能变化，只能全部重算
+        void touchPrerequisite(string_view prerequisite) noexcept {
+            if (priority == SchedulePriority::CriticalPath) dirtySemester = 0;
+            if (priority != SchedulePriority::MostDependents) return;
+            const u32 id = findCourse(prerequisite);
+            if (id != UINT32_MAX) markCourse(id, UINT32_MAX);
+        }
+    };
+}
\ No newline at end of file
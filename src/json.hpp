@@ -0,0 +1,217 @@
+﻿#pragma once
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Toposort::Json {
+    typedef uint8_t u8;
+    typedef uint32_t u32;
+    typedef uint64_t u64;
+    using std::string, std::string_view, std::vector, std::pair;
+
+    //最小的 JSON 读取器，只用于解析服务模式的请求；数字保留原文，由使用方按需要转换
+    struct Value {
+        enum class Type : u8 {
+            Null,
+            Boolean,
+            Number,
+            String,
+            Array,
+            Object,
+        };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        //字符串的内容或数字的原文
+        string text;
+        vector<Value> items;
+        vector<pair<string, Value>> members;
+
+        [[nodiscard]] const Value* find(string_view key) const noexcept {
+            for (const auto& [name, value] : members) if (name == key) return &value;
+            return nullptr;
+        }
+    };
+
+    class Parser {
+        static constexpr u32 maxDepth = 64;
+        string_view text;
+        u64 pos = 0;
+        string error;
+
+        void skipSpace() noexcept {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) pos++;
+        }
+
+        [[nodiscard]] bool fail(const char* message) noexcept {
+            if (error.empty()) error = string(message) + "（第 " + std::to_string(pos + 1) + " 个字符）";
+            return false;
+        }
+
+        [[nodiscard]] bool literal(string_view word) noexcept {
+            if (text.substr(pos, word.size()) != word) return fail("无法识别的值");
+            pos += word.size();
+            return true;
+        }
+
+        [[nodiscard]] bool hex4(u32& code) noexcept {
+            if (pos + 4 > text.size()) return fail("\\u 转义不完整");
+            const auto [ptr, ec] = std::from_chars(text.data() + pos, text.data() + pos + 4, code, 16);
+            if (ec != std::errc() || ptr != text.data() + pos + 4) return fail("\\u 转义无效");
+            pos += 4;
+            return true;
+        }
+
+        [[nodiscard]] bool parseString(string& out) noexcept {
+            pos++;
+            while (true) {
+                if (pos >= text.size()) return fail("字符串没有结束");
+                const char c = text[pos++];
+                if (c == '"') return true;
+                if (static_cast<u8>(c) < 0x20) return fail("字符串中有未转义的控制字符");
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+                if (pos >= text.size()) return fail("字符串没有结束");
+                switch (text[pos++]) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        u32 code = 0;
+                        if (!hex4(code)) return false;
+                        //代理对
+                        if (code >= 0xD800 && code < 0xDC00) {
+                            u32 low = 0;
+                            if (text.substr(pos, 2) != "\\u") return fail("代理对不完整");
+                            pos += 2;
+                            if (!hex4(low)) return false;
+                            if (low < 0xDC00 || low >= 0xE000) return fail("代理对无效");
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        else if (code >= 0xDC00 && code < 0xE000) return fail("代理对无效");
+                        if (code < 0x80) out += static_cast<char>(code);
+                        else if (code < 0x800) {
+                            out += static_cast<char>(0xC0 | (code >> 6));
+                            out += static_cast<char>(0x80 | (code & 0x3F));
+                        }
+                        else if (code < 0x10000) {
+                            out += static_cast<char>(0xE0 | (code >> 12));
+                            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                            out += static_cast<char>(0x80 | (code & 0x3F));
+                        }
+                        else {
+                            out += static_cast<char>(0xF0 | (code >> 18));
+                            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                            out += static_cast<char>(0x80 | (code & 0x3F));
+                        }
+                        break;
+                    }
+                    default: return fail("无效的转义字符");
+                }
+            }
+        }
+
+        [[nodiscard]] bool parseNumber(Value& value) noexcept {
+            const u64 start = pos;
+            if (pos < text.size() && text[pos] == '-') pos++;
+            while (pos < text.size() && ((text[pos] >= '0' && text[pos] <= '9') || text[pos] == '.' || text[pos] == 'e' || text[pos] == 'E' || text[pos] == '+' || text[pos] == '-')) pos++;
+            double number = 0;
+            const auto [ptr, ec] = std::from_chars(text.data() + start, text.data() + pos, number);
+            if (ec != std::errc() || ptr != text.data() + pos) return fail("数字格式错误");
+            value.type = Value::Type::Number;
+            value.text = text.substr(start, pos - start);
+            return true;
+        }
+
+        [[nodiscard]] bool parseValue(Value& value, u32 depth) noexcept {
+            if (depth > maxDepth) return fail("嵌套层数过多");
+            skipSpace();
+            if (pos >= text.size()) return fail("缺少值");
+            switch (text[pos]) {
+                case '{': {
+                    value.type = Value::Type::Object;
+                    pos++;
+                    skipSpace();
+                    if (pos < text.size() && text[pos] == '}') {
+                        pos++;
+                        return true;
+                    }
+                    while (true) {
+                        skipSpace();
+                        if (pos >= text.size() || text[pos] != '"') return fail("缺少字段名");
+                        auto& [name, member] = value.members.emplace_back();
+                        if (!parseString(name)) return false;
+                        skipSpace();
+                        if (pos >= text.size() || text[pos] != ':') return fail("缺少冒号");
+                        pos++;
+                        if (!parseValue(member, depth + 1)) return false;
+                        skipSpace();
+                        if (pos < text.size() && text[pos] == ',') pos++;
+                        else if (pos < text.size() && text[pos] == '}') {
+                            pos++;
+                            return true;
+                        }
+                        else return fail("缺少逗号或右花括号");
+                    }
+                }
+                case '[': {
+                    value.type = Value::Type::Array;
+                    pos++;
+                    skipSpace();
+                    if (pos < text.size() && text[pos] == ']') {
+                        pos++;
+                        return true;
+                    }
+                    while (true) {
+                        if (!parseValue(value.items.emplace_back(), depth + 1)) return false;
+                        skipSpace();
+                        if (pos < text.size() && text[pos] == ',') pos++;
+                        else if (pos < text.size() && text[pos] == ']') {
+                            pos++;
+                            return true;
+                        }
+                        else return fail("缺少逗号或右方括号");
+                    }
+                }
+                case '"':
+                    value.type = Value::Type::String;
+                    return parseString(value.text);
+                case 't':
+                    value.type = Value::Type::Boolean;
+                    value.boolean = true;
+                    return literal("true");
+                case 'f':
+                    value.type = Value::Type::Boolean;
+                    return literal("false");
+                case 'n':
+                    return literal("null");
+                default:
+                    return parseNumber(value);
+            }
+        }
+
+    public:
+        [[nodiscard]] explicit Parser(string_view text) noexcept : text(text) {}
+
+        //整段文本必须恰好是一个值，前后可以有空白
+        [[nodiscard]] bool parse(Value& value) noexcept {
+            if (!parseValue(value, 0)) return false;
+            skipSpace();
+            if (pos != text.size()) return fail("值之后有多余的字符");
+            return true;
+        }
+
+        [[nodiscard]] const string& getError() const noexcept { return error; }
+    };
+}
\ No newline at end of file
@@ -1,18 +1,45 @@
 ﻿#include <array>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #define CLI11_ENABLE_EXTRA_VALIDATORS 1
 #include <CLI/CLI.hpp>
 
+#include "batch.hpp"
+#include "cohorts.hpp"
+#include "diagnostics.hpp"
 #include "meta.hpp"
+#include "plans.hpp"
 #include "print.hpp"
+#include "server.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
 #include "toposort.hpp"
 #include "utils.hpp"
 
+//--stats 与 --trace 的设置，程序退出时（包括出错退出）输出
+struct StatsOptions {
+    bool show = false, json = false;
+    std::string traceFile;
+};
+
+inline StatsOptions statsOptions;
+
+void reportStats() noexcept {
+    using Toposort::Stats::report, Toposort::Stats::writeTrace;
+    if (statsOptions.show && Toposort::Stats::enabled) std::cerr << report(statsOptions.json) << std::endl;
+    std::string error;
+    if (!statsOptions.traceFile.empty() && !writeTrace(statsOptions.traceFile, error)) std::cerr << "错误：" << error << std::endl;
+}
+
 int main(int argc, char** argv) {
     typedef uint32_t u32;
-    using std::array, std::string, std::ofstream, std::vector, std::cout, std::cerr, std::endl, CLI::App, CLI::CallForHelp, CLI::CallForVersion, CLI::ParseError, Toposort::Utils::getLastError, Toposort::Course, Toposort::Schedule, Toposort::printArrangements, Toposort::printSchedules;
+    typedef uint64_t u64;
+    using std::array, std::string, std::ofstream, std::vector, std::cout, std::cerr, std::endl, CLI::App, CLI::CallForHelp, CLI::CallForVersion, CLI::ParseError, Toposort::Utils::Result, Toposort::Curriculum, Toposort::SchedulePriority, Toposort::PlacementOptions, Toposort::Schedule, Toposort::OutputFormat, Toposort::RunOptions, Toposort::BatchItem;
 
     #if _TOPOSORT_WINDOWS
         SetConsoleCP(CP_UTF8);
@@ -27,10 +54,47 @@ int main(int argc, char** argv) {
     app.set_version_flag("-v, --version", Toposort::TOPOSORT_SEMATIC_VERSION, "显示版本信息并退出。");
     app.set_config("");
     app.footer(Toposort::TOPOSORT_COPYRIGHT_NOTICE);
-    string inputFile;
-    app.add_option("-i,--input", inputFile, "指定输入文件路径。")->required()->check(CLI::ExistingFile | CLI::ReadPermissions);
+    vector<string> inputFiles;
+    app.add_option("-i,--input", inputFiles, "指定输入文件路径，可多次指定或指定目录（批量处理其中所有 .txt 文件）。")->check(CLI::ExistingPath | CLI::ReadPermissions);
+    string manifestFile;
+    app.add_option("--manifest", manifestFile, "指定清单文件，每行一个输入文件路径（批量处理）。")->check(CLI::ExistingFile | CLI::ReadPermissions);
     string outputFile;
-    app.add_option("-o,--output", outputFile, "指定输出文件路径。")->required();
+    app.add_option("-o,--output", outputFile, "指定输出文件路径；批量处理时为输出目录。服务模式下不需要。");
+    string priorityName = "file";
+    app.add_option("-p,--priority", priorityName, "指定选修课程的安排优先顺序：file（文件顺序）、dependents（后续课程多者优先）、credits（学时少者优先）、critical（先修链长、后续课程多者优先；课程很多时后续课程数按路径累加近似）。")->check(CLI::IsMember({"file", "dependents", "credits", "critical"}));
+    string formatName = "text";
+    app.add_option("-f,--format", formatName, "指定输出格式：text（表格）、json、csv（每个有课的时段一行）。json 与 csv 格式只写入输出文件。")->check(CLI::IsMember({"text", "json", "csv"}));
+    PlacementOptions placementOptions;
+    app.add_flag("--exact", placementOptions.exact, "贪心排课失败时改用精确搜索。");
+    bool softDaySpread = false;
+    app.add_flag("--soft-spread", softDaySpread, "精确搜索时允许同一课程的多次课安排在相邻或同一天（计入代价）。");
+    app.add_flag("--optimize", placementOptions.optimize, "精确搜索找到可行方案后继续寻找更符合时段偏好的方案。");
+    app.add_option("--search-limit", placementOptions.nodeLimit, "精确搜索每学期的节点数上限，0 表示不限制。");
+    app.add_option("--time-limit", placementOptions.timeLimit, "精确搜索每学期的时间上限（毫秒），0 表示不限制。");
+    u32 planCount = 0;
+    app.add_option("--plans", planCount, "不排课，改为输出最多 K 个满足约束的备选学期安排（只用于单个输入文件）。");
+    string planOrder = "first";
+    app.add_option("--plan-order", planOrder, "备选学期安排的选取方式：first（最先找到的 K 个，顺序由 --priority 决定）、best（学分最均衡的 K 个）。")->check(CLI::IsMember({"first", "best"}));
+    u64 planLimit = 1000;
+    app.add_option("--plan-limit", planLimit, "按 best 选取时最多比较的方案数，0 表示不限制。");
+    u64 planSearchLimit = 10000000;
+    app.add_option("--plan-search-limit", planSearchLimit, "枚举备选学期安排时尝试的组合数上限，0 表示不限制。");
+    string resourceFile;
+    app.add_option("--resources", resourceFile, "指定共用资源文件（每行：名称,容量,课程代码;课程代码…）：所有输入作为共用教师与教室的队列，各学期在同一张周课表上统一排课，输出到 -o 指定的目录。统一排课只使用贪心放置。")->check(CLI::ExistingFile | CLI::ReadPermissions);
+    string cacheDirectory;
+    app.add_option("--cache", cacheDirectory, "指定快照缓存目录：输入内容未变化时直接读取编译好的快照，跳过解析。输入文件本身也可以是快照。");
+    u32 threadCount = 1;
+    app.add_option("-j,--threads", threadCount, "排课（批量处理时为同时处理的文件）使用的线程数，0 表示使用全部硬件线程。");
+    bool serve = false;
+    app.add_flag("--serve", serve, "以服务模式运行：从标准输入（或 --socket）逐行读取 JSON 请求并逐行回复，-i 指定的文件预先加载，以文件名（不含扩展名）命名。");
+    string socketPath;
+    app.add_option("--socket", socketPath, "服务模式下监听该 Unix 域套接字，而不是使用标准输入输出。");
+    u64 queueSize = 64;
+    app.add_option("--queue-size", queueSize, "服务模式下等待处理的请求数上限，队列满时暂停读取新请求。");
+    app.add_flag("--stats", statsOptions.show, "结束时向标准错误输出各阶段耗时与计数。");
+    string statsFormat = "text";
+    app.add_option("--stats-format", statsFormat, "统计信息的格式：text 或 json。")->check(CLI::IsMember({"text", "json"}));
+    app.add_option("--trace", statsOptions.traceFile, "将各阶段的计时区间写入该文件（Chrome 跟踪格式）。");
     try { app.parse(argc, argv); }
     catch (const CallForHelp& e) {
         cout << app.help("", CLI::AppFormatMode::All) << endl;
@@ -44,32 +108,167 @@ int main(int argc, char** argv) {
         cerr << "参数错误：(" << e.get_exit_code() << ")" << e.get_name() << " " << e.what() << endl;
         exit(1);
     }
-    vector<Course> courses;
-    vector<u32> semesterLimits;
-    if (!Toposort::loadInfoFromFile(inputFile, courses, semesterLimits)) {
-        cerr << "错误：" << getLastError() << endl;
+    placementOptions.strictDaySpread = !softDaySpread;
+    statsOptions.json = statsFormat == "json";
+    if (statsOptions.show || !statsOptions.traceFile.empty()) {
+        if (!Toposort::Stats::enabled) cerr << "警告：此版本编译时未启用统计功能。" << endl;
+        if (!statsOptions.traceFile.empty()) Toposort::Stats::startTrace();
+        std::atexit(reportStats);
+    }
+    SchedulePriority priority = SchedulePriority::FileOrder;
+    if (priorityName == "dependents") priority = SchedulePriority::MostDependents;
+    else if (priorityName == "credits") priority = SchedulePriority::FewestCredits;
+    else if (priorityName == "critical") priority = SchedulePriority::CriticalPath;
+    OutputFormat format = OutputFormat::Text;
+    if (formatName == "json") format = OutputFormat::Json;
+    else if (formatName == "csv") format = OutputFormat::Csv;
+    std::error_code ec;
+    if (planCount != 0 && (serve || inputFiles.size() != 1 || !manifestFile.empty() || !resourceFile.empty() || std::filesystem::is_directory(inputFiles[0], ec))) {
+        cerr << "参数错误：--plans 只能用于单个输入文件。" << endl;
         exit(1);
     }
-    const vector<vector<string>> arrangements = Toposort::sortCourses(courses, semesterLimits);
-    if (arrangements.empty()) {
-        cerr << "错误：" << getLastError() << endl;
+    if (serve) {
+        Toposort::Server server({ .priority = priority, .placement = placementOptions, .format = format, .cacheDirectory = cacheDirectory }, threadCount, queueSize);
+        if (!inputFiles.empty() || !manifestFile.empty()) {
+            const Result<vector<std::filesystem::path>> inputs = Toposort::collectInputs(inputFiles, manifestFile);
+            if (!inputs.ok()) {
+                cerr << "错误：" << inputs.error << endl;
+                exit(1);
+            }
+            for (const std::filesystem::path& input : inputs.value) {
+                string error;
+                if (!server.preload(STR(input.stem()), STR(input), error)) {
+                    cerr << "错误：" << STR(input) << "：" << error << endl;
+                    exit(1);
+                }
+            }
+        }
+        if (socketPath.empty()) server.serveStdio();
+        else {
+            string error;
+            if (!server.serveSocket(socketPath, error)) {
+                cerr << "错误：" << error << endl;
+                exit(1);
+            }
+        }
+        return 0;
+    }
+    if (outputFile.empty()) {
+        cerr << "参数错误：需要指定 -o,--output。" << endl;
         exit(1);
     }
-    string arrangementStr = printArrangements(arrangements);
-    cout << arrangementStr << '\n';
-    const vector<Schedule> schedules = Toposort::getSchedules(courses, arrangements);
-    if (schedules.empty()) {
-        cerr << "错误：" << getLastError() << endl;
+    if (inputFiles.size() != 1 || !manifestFile.empty() || !resourceFile.empty() || std::filesystem::is_directory(inputFiles[0], ec)) {
+        const Result<vector<std::filesystem::path>> inputs = Toposort::collectInputs(inputFiles, manifestFile);
+        if (!inputs.ok()) {
+            cerr << "错误：" << inputs.error << endl;
+            exit(1);
+        }
+        if (!std::filesystem::is_directory(outputFile, ec) && !std::filesystem::create_directories(outputFile, ec)) {
+            cerr << "错误：无法创建输出目录：" << outputFile << endl;
+            exit(1);
+        }
+        vector<BatchItem> items = Toposort::planBatch(inputs.value, outputFile, format);
+        const RunOptions runOptions = { .priority = priority, .placement = placementOptions, .format = format, .cacheDirectory = cacheDirectory };
+        if (resourceFile.empty()) Toposort::runBatch(items, runOptions, threadCount);
+        else {
+            const Result<vector<Toposort::Resource>> resources = Toposort::loadResources(resourceFile);
+            if (!resources.ok()) {
+                cerr << "错误：" << resources.error << endl;
+                exit(1);
+            }
+            string error;
+            if (!Toposort::runCohorts(items, resources.value, runOptions, threadCount, error)) {
+                for (u64 pos = 0, end; pos < error.size(); pos = end + 1) {
+                    end = std::min(error.find('\n', pos), error.size());
+                    cerr << "错误：" << std::string_view(error).substr(pos, end - pos) << '\n';
+                }
+                cerr.flush();
+                exit(1);
+            }
+        }
+        bool failed = false;
+        for (const BatchItem& item : items) {
+            if (item.error.empty()) cout << "已写入到输出文件：" << STR(item.output) << '\n';
+            else {
+                cerr << "错误：" << STR(item.input) << "：" << item.error << '\n';
+                failed = true;
+            }
+        }
+        cout.flush();
+        return failed ? 1 : 0;
+    }
+    const Result<Curriculum> curriculum = Toposort::loadCurriculum(inputFiles[0], cacheDirectory);
+    if (!curriculum.ok()) {
+        cerr << "错误：" << curriculum.error << endl;
         exit(1);
     }
-    string scheduleStr = printSchedules(schedules);
-    cout << scheduleStr << '\n';
-    ofstream output(outputFile, std::ios::out);
-    if (!output.is_open()) {
-        cerr << "错误：无法打开输出文件：" << outputFile << endl;
+    const vector<string> problems = Toposort::diagnoseCurriculum(curriculum.value);
+    if (!problems.empty()) {
+        for (const string& problem : problems) cerr << "错误：" << problem << '\n';
         exit(1);
     }
-    output << arrangementStr << '\n' << scheduleStr;
+    const auto writeOutput = [&](const string& buffer) noexcept {
+        const Toposort::Stats::Span writeSpan(Toposort::Stats::Phase::Write);
+        ofstream output(outputFile, std::ios::out);
+        if (!output.is_open()) {
+            cerr << "错误：无法打开输出文件：" << outputFile << endl;
+            exit(1);
+        }
+        output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    };
+    //只输出备选的学期安排，不排课
+    if (planCount != 0) {
+        const vector<Toposort::Course>& courses = curriculum.value.courses;
+        Toposort::PlanEnumerator enumerator(courses, curriculum.value.graph, curriculum.value.semesterLimits, priority, planSearchLimit);
+        vector<vector<vector<u32>>> plans;
+        vector<double> scores;
+        if (planOrder == "best") {
+            for (auto& [score, plan] : Toposort::bestPlans(enumerator, planCount, [&](const vector<vector<u32>>& plan) noexcept { return Toposort::getCreditBalance(courses, plan); }, planLimit)) {
+                scores.push_back(score);
+                plans.push_back(std::move(plan));
+            }
+        }
+        else plans = Toposort::firstPlans(enumerator, planCount);
+        if (plans.empty()) {
+            cerr << "错误：" << (enumerator.exhausted() ? "没有满足约束的学期安排。" : "在搜索上限内没有找到满足约束的学期安排。") << endl;
+            exit(1);
+        }
+        string buffer;
+        Toposort::Stats::Span renderSpan(Toposort::Stats::Phase::Render);
+        Toposort::renderPlans(buffer, format, courses, plans, scores);
+        renderSpan.stop();
+        if (format == OutputFormat::Text) cout << buffer << '\n';
+        writeOutput(buffer);
+        cout << "已写入到输出文件：" << outputFile << endl;
+        return 0;
+    }
+    const Result<vector<vector<u32>>> arrangements = Toposort::sortCourses(curriculum.value.courses, curriculum.value.graph, curriculum.value.semesterLimits, priority);
+    if (!arrangements.ok()) {
+        cerr << "错误：" << arrangements.error << endl;
+        exit(1);
+    }
+    //文本格式先输出课程安排再排课，与之后的课表共用同一个缓冲区
+    string buffer;
+    if (format == OutputFormat::Text) {
+        const Toposort::Stats::Span span(Toposort::Stats::Phase::Render);
+        Toposort::renderArrangements(buffer, curriculum.value.courses, arrangements.value);
+        cout << buffer << '\n';
+    }
+    const Result<vector<Schedule>> schedules = Toposort::getSchedules(curriculum.value.courses, arrangements.value, placementOptions, threadCount);
+    if (!schedules.ok()) {
+        cerr << "错误：" << schedules.error << endl;
+        exit(1);
+    }
+    Toposort::Stats::Span renderSpan(Toposort::Stats::Phase::Render);
+    if (format == OutputFormat::Text) {
+        buffer += '\n';
+        const u64 scheduleStart = buffer.size();
+        Toposort::renderSchedules(buffer, curriculum.value.courses, arrangements.value, schedules.value);
+        cout << std::string_view(buffer).substr(scheduleStart) << '\n';
+    }
+    else Toposort::renderResult(buffer, format, curriculum.value.courses, arrangements.value, schedules.value);
+    renderSpan.stop();
+    writeOutput(buffer);
     cout << "已写入到输出文件：" << outputFile << endl;
     return 0;
 }
\ No newline at end of file
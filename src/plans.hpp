@@ -0,0 +1,266 @@
+﻿#pragma once
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "toposort.hpp"
+
+namespace Toposort {
+    using std::vector, std::pair, std::move;
+
+    //按需逐个生成满足约束的学期安排：每门课程恰好安排一次，先修课程在更早的学期，指定学期的课程在指定学期，
+    //每学期不超过课程数上限和 50 学分。plan[i] 为第 i + 1 学期的课程，可以为空。
+    //深度优先搜索的状态保存在显式栈中，每层只保存该学期的候选课程和当前组合，不会生成全部方案
+    class PlanEnumerator {
+        struct Level {
+            //本学期必须安排的课程（指定本学期，或推迟会导致后续课程无法安排），以及按优先顺序排列的可选课程
+            vector<u32> required, candidates;
+            //当前组合在 candidates 中的下标
+            vector<u32> chosen;
+            u32 size, minSize, requiredCredits;
+            bool started = false, applied = false;
+        };
+
+        const vector<Course>& courses;
+        const CourseGraph& graph;
+        const vector<u32>& semesterLimits;
+        vector<u64> keys;
+        //拓扑序，无法拓扑排序时没有任何方案
+        vector<u32> order;
+        //pushLevel 使用的临时数组：每门课程最早与最晚可安排的学期，以及按学期统计的课程数与学分
+        vector<u32> earliest, latest;
+        vector<u64> dueCount, dueCredits, releaseCount, releaseCredits;
+        vector<bool> scheduled;
+        //laterCapacity[i] 为第 i + 1 学期之后各学期的课程数上限之和
+        vector<u64> laterCapacity;
+        vector<Level> stack;
+        //已尝试的组合数及其上限，0 表示不限制
+        u64 nodes = 0, nodeLimit;
+        u32 scheduledCount = 0;
+        bool started = false, finished = false, stopped = false;
+
+        void apply(const Level& level, bool undo) noexcept {
+            for (const u32 course : level.required) scheduled[course] = !undo;
+            for (const u32 index : level.chosen) scheduled[level.candidates[index]] = !undo;
+            const u32 count = static_cast<u32>(level.required.size() + level.chosen.size());
+            scheduledCount = undo ? scheduledCount - count : scheduledCount + count;
+        }
+
+        //进入下一个学期，剪枝条件不满足时返回 false 且不入栈。对每门未安排的课程按先修链求出最早与最晚可安排的学期，
+        //要求区间非空、最晚学期不超过 k 的课程能放进当前学期到第 k 学期、最早学期不早于 k 的课程能放进第 k 学期到最后一学期
+        [[nodiscard]] bool pushLevel() noexcept {
+            const u32 semester = static_cast<u32>(stack.size()), semesterCount = static_cast<u32>(semesterLimits.size());
+            for (const u32 course : order) {
+                if (scheduled[course]) continue;
+                const u32 pin = courses[course].semester;
+                if (pin != 0 && pin <= semester) return false;
+                earliest[course] = pin == 0 ? semester : pin - 1;
+                latest[course] = pin == 0 ? semesterCount - 1 : pin - 1;
+            }
+            for (u32 i = static_cast<u32>(order.size()); i-- > 0;) {
+                const u32 course = order[i];
+                if (scheduled[course]) continue;
+                for (u32 j = graph.offsets[course]; j < graph.offsets[course + 1]; j++) {
+                    const u32 dependent = graph.dependents[j];
+                    if (latest[dependent] == 0) return false;
+                    latest[course] = std::min(latest[course], latest[dependent] - 1);
+                }
+            }
+            std::fill(dueCount.begin(), dueCount.end(), 0);
+            std::fill(dueCredits.begin(), dueCredits.end(), 0);
+            std::fill(releaseCount.begin(), releaseCount.end(), 0);
+            std::fill(releaseCredits.begin(), releaseCredits.end(), 0);
+            Level level;
+            level.requiredCredits = 0;
+            u64 unscheduled = 0;
+            for (const u32 course : order) {
+                if (scheduled[course]) continue;
+                unscheduled++;
+                if (earliest[course] > latest[course]) return false;
+                for (u32 j = graph.offsets[course]; j < graph.offsets[course + 1]; j++) earliest[graph.dependents[j]] = std::max(earliest[graph.dependents[j]], earliest[course] + 1);
+                dueCount[latest[course]]++;
+                dueCredits[latest[course]] += courses[course].credit;
+                releaseCount[earliest[course]]++;
+                releaseCredits[earliest[course]] += courses[course].credit;
+                if (latest[course] == semester) {
+                    level.required.push_back(course);
+                    level.requiredCredits += courses[course].credit;
+                }
+                else if (earliest[course] == semester) level.candidates.push_back(course);
+            }
+            u64 count = 0, credits = 0, capacity = 0;
+            for (u32 i = semester; i < semesterCount; i++) {
+                count += dueCount[i];
+                credits += dueCredits[i];
+                capacity += semesterLimits[i];
+                if (count > capacity || credits > 50ull * (i - semester + 1)) return false;
+            }
+            count = credits = capacity = 0;
+            for (u32 i = semesterCount; i-- > semester;) {
+                count += releaseCount[i];
+                credits += releaseCredits[i];
+                capacity += semesterLimits[i];
+                if (count > capacity || credits > 50ull * (semesterCount - i)) return false;
+            }
+            const u32 limit = semesterLimits[semester];
+            if (level.required.size() > limit || level.requiredCredits > 50) return false;
+            std::sort(level.required.begin(), level.required.end());
+            std::sort(level.candidates.begin(), level.candidates.end(), [&](u32 a, u32 b) noexcept { return keys[a] < keys[b]; });
+            level.size = static_cast<u32>(std::min<u64>(limit - level.required.size(), level.candidates.size()));
+            const u64 remaining = unscheduled - level.required.size();
+            level.minSize = remaining > laterCapacity[semester] ? static_cast<u32>(remaining - laterCapacity[semester]) : 0;
+            if (level.minSize > level.size) return false;
+            stack.push_back(move(level));
+            return true;
+        }
+
+        //换到本学期的下一个组合（课程数从多到少，同样多时按优先顺序的字典序），没有更多组合时返回 false
+        [[nodiscard]] bool advance(Level& level) noexcept {
+            if (level.applied) {
+                apply(level, true);
+                level.applied = false;
+            }
+            const u32 candidateCount = static_cast<u32>(level.candidates.size());
+            while (true) {
+                if (nodeLimit != 0 && nodes++ >= nodeLimit) {
+                    stopped = true;
+                    return false;
+                }
+                if (!level.started) {
+                    level.started = true;
+                    level.chosen.resize(level.size);
+                    for (u32 i = 0; i < level.size; i++) level.chosen[i] = i;
+                }
+                else {
+                    u32 i = level.size;
+                    while (i > 0 && level.chosen[i - 1] == candidateCount - level.size + i - 1) i--;
+                    if (i == 0) {
+                        if (level.size == level.minSize) return false;
+                        level.size--;
+                        level.started = false;
+                        continue;
+                    }
+                    level.chosen[i - 1]++;
+                    for (u32 j = i; j < level.size; j++) level.chosen[j] = level.chosen[j - 1] + 1;
+                }
+                u32 credits = level.requiredCredits;
+                for (const u32 index : level.chosen) credits += courses[level.candidates[index]].credit;
+                if (credits > 50) continue;
+                apply(level, false);
+                level.applied = true;
+                return true;
+            }
+        }
+
+    public:
+        //priority 决定每学期可选课程的尝试顺序，因此也决定方案生成的顺序。
+        //剪枝只检查总量，学分难以拼凑的无解输入可能需要尝试极多组合，nodeLimit 限制尝试的组合总数（0 表示不限制）
+        [[nodiscard]] explicit PlanEnumerator(const vector<Course>& courses, const CourseGraph& graph, const vector<u32>& semesterLimits, SchedulePriority priority = SchedulePriority::FileOrder, u64 nodeLimit = 0) noexcept
+            : courses(courses), graph(graph), semesterLimits(semesterLimits), earliest(graph.size(), 0), latest(graph.size(), 0), dueCount(semesterLimits.size()), dueCredits(semesterLimits.size()), releaseCount(semesterLimits.size()), releaseCredits(semesterLimits.size()), scheduled(graph.size(), false), laterCapacity(semesterLimits.size(), 0), nodeLimit(nodeLimit) {
+            const u32 courseCount = graph.size();
+            if (courses.empty() || semesterLimits.empty() || courseCount != courses.size()) {
+                finished = true;
+                return;
+            }
+            const vector<u32> criticalRanks = priority == SchedulePriority::CriticalPath ? getCriticalPathRanks(graph) : vector<u32>();
+            keys.resize(courseCount);
+            for (u32 i = 0; i < courseCount; i++) keys[i] = getPriorityKey(courses, graph, priority, i, criticalRanks);
+            vector<u32> remaining(graph.inDegree);
+            order.reserve(courseCount);
+            for (u32 i = 0; i < courseCount; i++) if (remaining[i] == 0) order.push_back(i);
+            for (u32 i = 0; i < order.size(); i++) for (u32 j = graph.offsets[order[i]]; j < graph.offsets[order[i] + 1]; j++) if (--remaining[graph.dependents[j]] == 0) order.push_back(graph.dependents[j]);
+            if (order.size() != courseCount) {
+                finished = true;
+                return;
+            }
+            for (u64 i = semesterLimits.size() - 1; i-- > 0;) laterCapacity[i] = laterCapacity[i + 1] + semesterLimits[i + 1];
+            for (const Course& course : courses) if (course.credit > 50 || course.semester > semesterLimits.size()) finished = true;
+        }
+
+        //生成下一个方案，没有更多方案时返回 false
+        [[nodiscard]] bool next(vector<vector<u32>>& plan) noexcept {
+            if (finished) return false;
+            if (!started) {
+                started = true;
+                if (!pushLevel()) {
+                    finished = true;
+                    return false;
+                }
+            }
+            while (!stack.empty()) {
+                if (!advance(stack.back())) {
+                    if (stopped) break;
+                    stack.pop_back();
+                    continue;
+                }
+                if (stack.size() < semesterLimits.size()) {
+                    (void)pushLevel();
+                    continue;
+                }
+                if (scheduledCount != courses.size()) continue;
+                plan.resize(stack.size());
+                for (u64 i = 0; i < stack.size(); i++) {
+                    plan[i] = stack[i].required;
+                    for (const u32 index : stack[i].chosen) plan[i].push_back(stack[i].candidates[index]);
+                }
+                return true;
+            }
+            finished = true;
+            return false;
+        }
+
+        //next 返回 false 后，表示是否已完整枚举（而不是因达到 nodeLimit 而停止）
+        [[nodiscard]] bool exhausted() const noexcept { return finished && !stopped; }
+    };
+
+    //学分均衡程度：各学期学分与平均学分之差的平方和取负，越大越均衡；没有课程的学期也计入
+    [[nodiscard]] inline double getCreditBalance(const vector<Course>& courses, const vector<vector<u32>>& plan) noexcept {
+        if (plan.empty()) return 0;
+        vector<double> credits(plan.size(), 0);
+        double total = 0;
+        for (u64 i = 0; i < plan.size(); i++) {
+            for (const u32 course : plan[i]) credits[i] += courses[course].credit;
+            total += credits[i];
+        }
+        const double mean = total / static_cast<double>(plan.size());
+        double score = 0;
+        for (const double credit : credits) score -= (credit - mean) * (credit - mean);
+        return score;
+    }
+
+    //最先生成的 count 个方案
+    [[nodiscard]] inline vector<vector<vector<u32>>> firstPlans(PlanEnumerator& enumerator, u32 count) noexcept {
+        vector<vector<vector<u32>>> plans;
+        vector<vector<u32>> plan;
+        while (plans.size() < count && enumerator.next(plan)) plans.push_back(plan);
+        return plans;
+    }
+
+    //在最多 maxPlans 个方案（0 表示不限制）中按 score 取得分最高的 count 个，得分相同时先生成的优先；
+    //只保留当前最好的 count 个方案，结果按得分从高到低排列
+    template<typename Score> [[nodiscard]] inline vector<pair<double, vector<vector<u32>>>> bestPlans(PlanEnumerator& enumerator, u32 count, const Score& score, u64 maxPlans = 0) noexcept {
+        //（得分，生成序号，方案），以 better 为比较函数的堆，堆顶为当前保留的最差方案
+        typedef std::tuple<double, u64, vector<vector<u32>>> Entry;
+        const auto better = [](const Entry& a, const Entry& b) noexcept { return std::get<0>(a) != std::get<0>(b) ? std::get<0>(a) > std::get<0>(b) : std::get<1>(a) < std::get<1>(b); };
+        vector<Entry> kept;
+        kept.reserve(count);
+        vector<vector<u32>> plan;
+        for (u64 generated = 0; count > 0 && (maxPlans == 0 || generated < maxPlans) && enumerator.next(plan); generated++) {
+            Entry entry = { static_cast<double>(score(plan)), generated, vector<vector<u32>>() };
+            if (kept.size() == count) {
+                if (!better(entry, kept.front())) continue;
+                std::pop_heap(kept.begin(), kept.end(), better);
+                kept.pop_back();
+            }
+            std::get<2>(entry) = plan;
+            kept.push_back(move(entry));
+            std::push_heap(kept.begin(), kept.end(), better);
+        }
+        std::sort_heap(kept.begin(), kept.end(), better);
+        vector<pair<double, vector<vector<u32>>>> result;
+        result.reserve(kept.size());
+        for (Entry& entry : kept) result.emplace_back(std::get<0>(entry), move(std::get<2>(entry)));
+        return result;
+    }
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 ﻿#pragma once
 #include <array>
-#include <iostream>
+#include <bit>
+#include <cstdio>
+#include <cstring>
 #include <ostream>
 #include <string>
 #include <string_view>
@@ -11,27 +13,47 @@
 namespace Toposort {
     typedef uint8_t u8;
     typedef uint64_t u64;
-    using std::array, std::max, std::string, std::stringstream, std::string_view, std::vector;
+    using std::array, std::max, std::string, std::string_view, std::vector, std::to_string;
 
-    inline string printArrangements(const vector<vector<string>>& arrangements) noexcept {
-        stringstream result;
+    //输出格式：text 为带边框的表格，json 与 csv 供其他工具读取
+    enum class OutputFormat : u8 {
+        Text,
+        Json,
+        Csv,
+    };
+
+    //各输出函数都将内容追加到调用方提供的缓冲区末尾，缓冲区可以在多次输出之间复用
+    inline void renderArrangements(string& out, const vector<Course>& courses, const vector<vector<u32>>& arrangements) noexcept {
         for (u64 i = 0; i < arrangements.size(); i++) {
-            result << "第 " << i + 1 << " 学期：";
+            out += "第 ";
+            out += to_string(i + 1);
+            out += " 学期：";
+            //备选学期安排中可能有空的学期
+            if (arrangements[i].empty()) out += "（无课程）";
             for (u64 j = 0; j < arrangements[i].size(); j++) {
-                result << arrangements[i][j];
-                if (j < arrangements[i].size() - 1) result << ", ";
+                out += courses[arrangements[i][j]].code;
+                if (j < arrangements[i].size() - 1) out += ", ";
             }
-            if (i < arrangements.size() - 1) result << '\n';
+            if (i < arrangements.size() - 1) out += '\n';
         }
-        return result.str();
     }
 
     inline constexpr array<string_view, 5> dayNames = { "星期一", "星期二", "星期三", "星期四", "星期五" };
     inline constexpr array<string_view, 10> slotNames = { "│ 第1节  │", "│ 第2节  │", "│ 第3节  │", "│ 第4节  │", "│ 第5节  │", "│ 第6节  │", "│ 第7节  │", "│ 第8节  │", "│ 第9节  │", "│ 第10节 │" };
 
+    //ASCII 字符宽度为 1，其余字符宽度为 2；纯 ASCII 的部分每次检查 8 个字节
     [[nodiscard]] inline u64 getTextWidthWithPadding(const string_view& text) noexcept {
         u64 width = 0;
         for (u64 i = 0; i < text.length(); i++) {
+            if (i + 8 <= text.length()) {
+                u64 word;
+                std::memcpy(&word, text.data() + i, 8);
+                if ((word & 0x8080808080808080ull) == 0) {
+                    width += 8;
+                    i += 7;
+                    continue;
+                }
+            }
             const u8 c = text[i];
             if ((c & 0x80) == 0) width++;
             else if ((c & 0xE0) == 0xC0) {
@@ -50,60 +72,240 @@ namespace Toposort {
         return width;
     }
 
-    inline void printSeparator(stringstream& result, const array<u64, 5>& maxWidths) noexcept {
-        result << "├────────┼";
+    //一组列宽对应的三种横线，列宽相同的课表共用
+    struct BorderRows {
+        array<u64, 5> widths;
+        string top, separator, bottom;
+    };
+
+    [[nodiscard]] inline BorderRows makeBorderRows(const array<u64, 5>& widths) noexcept {
+        BorderRows rows = { .widths = widths, .top = "┌────────┬", .separator = "├────────┼", .bottom = "└────────┴" };
         for (u8 i = 0; i < 5; i++) {
-            for (u64 j = 0; j < maxWidths[i] + 2; j++) result << "─";
-            result << (i < 4 ? "┼" : "┤");
+            for (u64 j = 0; j < widths[i] + 2; j++) {
+                rows.top += "─";
+                rows.separator += "─";
+                rows.bottom += "─";
+            }
+            rows.top += i < 4 ? "┬" : "┐";
+            rows.separator += i < 4 ? "┼" : "┤";
+            rows.bottom += i < 4 ? "┴" : "┘";
         }
-        result << '\n';
+        rows.top += '\n';
+        rows.separator += '\n';
+        return rows;
     }
 
-    inline void printBorder(stringstream& result, const array<u64, 5>& maxWidths, bool top) noexcept {
-        result << (top ? "┌────────┬" : "└────────┴");
-        for (u32 i = 0; i < 5; i++) {
-            for (u64 j = 0; j < maxWidths[i] + 2; j++) result << "─";
-            result << (i < 4 ? (top ? "┬" : "┴") : (top ? "┐" : "┘"));
-        }
-        if (top) result << '\n';
+    inline void renderCell(string& out, const string_view& text, u64 width) noexcept {
+        const u64 textWidth = getTextWidthWithPadding(text), padding = width > textWidth ? width - textWidth : 0, leftPadding = padding / 2;
+        out.append(leftPadding + 1, ' ');
+        out += text;
+        out.append(padding - leftPadding + 1, ' ');
+        out += "│";
     }
 
-    inline void printCell(stringstream& result, const string_view& text, u64 width) noexcept {
-        const u64 textWidth = getTextWidthWithPadding(text), padding = width > textWidth ? width - textWidth : 0, leftPadding = padding / 2;
-        for (u64 i = 0; i <= leftPadding; i++) result << " ";
-        result << text;
-        for (u64 i = 0; i <= padding - leftPadding; i++) result << " ";
-        result << "│";
+    //课表中保存的是课程在该学期安排中的下标，输出时才解析为课程名称
+    [[nodiscard]] inline string_view getSlotName(const vector<Course>& courses, const vector<u32>& arrangement, u8 slot) noexcept {
+        return slot == Schedule::emptySlot ? string_view() : string_view(courses[arrangement[slot]].name);
     }
 
-    inline string printSchedules(const vector<Schedule>& schedules) noexcept {
-        stringstream result;
+    inline void renderSchedules(string& out, const vector<Course>& courses, const vector<vector<u32>>& arrangements, const vector<Schedule>& schedules) noexcept {
+        vector<BorderRows> borders;
         for (u64 i = 0; i < schedules.size(); i++) {
             array<u64, 5> maxWidths = { 0, 0, 0, 0, 0 };
             for (u8 j = 0; j < 5; j++) {
-                maxWidths[j] = max(8ull, getTextWidthWithPadding(dayNames[j]));
+                maxWidths[j] = max<u64>(8, getTextWidthWithPadding(dayNames[j]));
                 for (u8 k = 0; k < 10; k++) {
-                    const string& courseName = schedules[i].slots[j][k];
-                    if (!courseName.empty()) {
-                        u64 len = getTextWidthWithPadding(courseName);
-                        maxWidths[j] = max(maxWidths[j], len);
-                    }
+                    const string_view courseName = getSlotName(courses, arrangements[i], schedules[i].slots[j][k]);
+                    if (!courseName.empty()) maxWidths[j] = max(maxWidths[j], getTextWidthWithPadding(courseName));
                 }
             }
-            printBorder(result, maxWidths, true);
-            result << "│  节次  │";
-            for (u8 j = 0; j < 5; j++) printCell(result, dayNames[j], maxWidths[j]);
-            result << '\n';
-            printSeparator(result, maxWidths);
+            u64 border = 0;
+            while (border < borders.size() && borders[border].widths != maxWidths) border++;
+            if (border == borders.size()) borders.push_back(makeBorderRows(maxWidths));
+            const BorderRows& rows = borders[border];
+            out += rows.top;
+            out += "│  节次  │";
+            for (u8 j = 0; j < 5; j++) renderCell(out, dayNames[j], maxWidths[j]);
+            out += '\n';
+            out += rows.separator;
             for (u8 j = 0; j < 10; j++) {
-                result << slotNames[j];
-                for (u8 k = 0; k < 5; k++) printCell(result, schedules[i].slots[k][j], maxWidths[k]);
-                result << '\n';
-                if (j < 9) printSeparator(result, maxWidths);
+                out += slotNames[j];
+                for (u8 k = 0; k < 5; k++) renderCell(out, getSlotName(courses, arrangements[i], schedules[i].slots[k][j]), maxWidths[k]);
+                out += '\n';
+                if (j < 9) out += rows.separator;
             }
-            printBorder(result, maxWidths, false);
-            if (i < schedules.size() - 1) result << '\n';
+            out += rows.bottom;
+            if (i < schedules.size() - 1) out += '\n';
+        }
+    }
+
+    inline void renderJsonString(string& out, string_view text) noexcept {
+        constexpr char hexDigits[] = "0123456789abcdef";
+        out += '"';
+        for (const char c : text) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<u8>(c) < 0x20) {
+                        out += "\\u00";
+                        out += hexDigits[c >> 4];
+                        out += hexDigits[c & 0xF];
+                    }
+                    else out += c;
+            }
+        }
+        out += '"';
+    }
+
+    //{"semesters":[{"semester":1,"courses":[{"code":…,"name":…,"credit":…}],"schedule":[[每天各节次的课程代码或 null]]}]}
+    inline void renderJson(string& out, const vector<Course>& courses, const vector<vector<u32>>& arrangements, const vector<Schedule>& schedules) noexcept {
+        out += "{\"semesters\":[";
+        for (u64 i = 0; i < arrangements.size(); i++) {
+            if (i > 0) out += ',';
+            out += "\n{\"semester\":";
+            out += to_string(i + 1);
+            out += ",\"courses\":[";
+            for (u64 j = 0; j < arrangements[i].size(); j++) {
+                const Course& course = courses[arrangements[i][j]];
+                if (j > 0) out += ',';
+                out += "{\"code\":";
+                renderJsonString(out, course.code);
+                out += ",\"name\":";
+                renderJsonString(out, course.name);
+                out += ",\"credit\":";
+                out += to_string(course.credit);
+                out += '}';
+            }
+            out += "],\"schedule\":[";
+            for (u32 day = 0; day < Schedule::days; day++) {
+                if (day > 0) out += ',';
+                out += '[';
+                for (u32 slot = 0; slot < Schedule::slotsPerDay; slot++) {
+                    if (slot > 0) out += ',';
+                    const u8 index = schedules[i].slots[day][slot];
+                    if (index == Schedule::emptySlot) out += "null";
+                    else renderJsonString(out, courses[arrangements[i][index]].code);
+                }
+                out += ']';
+            }
+            out += "]}";
+        }
+        out += "\n]}";
+    }
+
+    inline void renderCsvField(string& out, string_view text) noexcept {
+        if (text.find_first_of(",\"\r\n") == string_view::npos) {
+            out += text;
+            return;
+        }
+        out += '"';
+        for (const char c : text) {
+            if (c == '"') out += '"';
+            out += c;
+        }
+        out += '"';
+    }
+
+    //每个有课的时段一行：学期、星期（1-5）、节次（1-10）、课程代码、课程名称
+    inline void renderCsv(string& out, const vector<Course>& courses, const vector<vector<u32>>& arrangements, const vector<Schedule>& schedules) noexcept {
+        out += "semester,day,slot,code,name\n";
+        for (u64 i = 0; i < schedules.size(); i++) for (u32 day = 0; day < Schedule::days; day++) for (u32 slot = 0; slot < Schedule::slotsPerDay; slot++) {
+            const u8 index = schedules[i].slots[day][slot];
+            if (index == Schedule::emptySlot) continue;
+            const Course& course = courses[arrangements[i][index]];
+            out += to_string(i + 1);
+            out += ',';
+            out += to_string(day + 1);
+            out += ',';
+            out += to_string(slot + 1);
+            out += ',';
+            renderCsvField(out, course.code);
+            out += ',';
+            renderCsvField(out, course.name);
+            out += '\n';
+        }
+    }
+
+    //输出多个备选的学期安排，scores 为空时不输出得分。text 为每个方案一段，json 为 {"plans":[{"score":…,"semesters":[[课程代码]]}]}，
+    //csv 为每门课程一行：方案序号、学期、课程代码、课程名称。方案中没有课程的学期保留序号，text 标为（无课程），
+    //json 为空数组，csv 为课程代码与名称都为空的一行
+    inline void renderPlans(string& out, OutputFormat format, const vector<Course>& courses, const vector<vector<vector<u32>>>& plans, const vector<double>& scores) noexcept {
+        char number[32];
+        const auto score = [&](u64 i) noexcept {
+            std::snprintf(number, sizeof(number), "%.3f", scores[i]);
+            return string_view(number);
+        };
+        switch (format) {
+            case OutputFormat::Text:
+                for (u64 i = 0; i < plans.size(); i++) {
+                    out += "方案 ";
+                    out += to_string(i + 1);
+                    if (!scores.empty()) {
+                        out += "（得分 ";
+                        out += score(i);
+                        out += "）";
+                    }
+                    out += "：\n";
+                    renderArrangements(out, courses, plans[i]);
+                    if (i < plans.size() - 1) out += "\n\n";
+                }
+                break;
+            case OutputFormat::Json:
+                out += "{\"plans\":[";
+                for (u64 i = 0; i < plans.size(); i++) {
+                    out += i > 0 ? ",\n{" : "\n{";
+                    if (!scores.empty()) {
+                        out += "\"score\":";
+                        out += score(i);
+                        out += ',';
+                    }
+                    out += "\"semesters\":[";
+                    for (u64 j = 0; j < plans[i].size(); j++) {
+                        out += j > 0 ? ",[" : "[";
+                        for (u64 k = 0; k < plans[i][j].size(); k++) {
+                            if (k > 0) out += ',';
+                            renderJsonString(out, courses[plans[i][j][k]].code);
+                        }
+                        out += ']';
+                    }
+                    out += "]}";
+                }
+                out += "\n]}";
+                break;
+            case OutputFormat::Csv:
+                out += "plan,semester,code,name\n";
+                for (u64 i = 0; i < plans.size(); i++) for (u64 j = 0; j < plans[i].size(); j++) {
+                    const auto row = [&](string_view code, string_view name) noexcept {
+                        out += to_string(i + 1);
+                        out += ',';
+                        out += to_string(j + 1);
+                        out += ',';
+                        renderCsvField(out, code);
+                        out += ',';
+                        renderCsvField(out, name);
+                        out += '\n';
+                    };
+                    if (plans[i][j].empty()) row({}, {});
+                    for (const u32 course : plans[i][j]) row(courses[course].code, courses[course].name);
+                }
+                break;
+        }
+    }
+
+    //按格式输出完整结果，text 格式与分别输出安排和课表时相同
+    inline void renderResult(string& out, OutputFormat format, const vector<Course>& courses, const vector<vector<u32>>& arrangements, const vector<Schedule>& schedules) noexcept {
+        switch (format) {
+            case OutputFormat::Text:
+                renderArrangements(out, courses, arrangements);
+                out += '\n';
+                renderSchedules(out, courses, arrangements, schedules);
+                break;
+            case OutputFormat::Json: renderJson(out, courses, arrangements, schedules); break;
+            case OutputFormat::Csv: renderCsv(out, courses, arrangements, schedules); break;
         }
-        return result.str();
     }
 }
\ No newline at end of file
@@ -0,0 +1,521 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "batch.hpp"
+#include "diagnostics.hpp"
+#include "incremental.hpp"
+#include "json.hpp"
+#include "print.hpp"
+#include "snapshot.hpp"
+#include "toposort.hpp"
+#include "utils.hpp"
+
+#if _TOPOSORT_UNIX
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+
+namespace Toposort {
+    using std::string, std::string_view, std::vector, std::pair, std::unordered_map, std::shared_ptr, std::make_shared, std::move, Utils::Result, Utils::BoundedQueue;
+
+    //服务模式的一个回复通道（标准输出或一个套接字连接），每条回复整行写出，多个工作线程不会交错
+    class Channel {
+        std::mutex mutex;
+        //-1 表示标准输出
+        int fd;
+
+    public:
+        [[nodiscard]] explicit Channel(int fd = -1) noexcept : fd(fd) {}
+        Channel(const Channel&) = delete;
+        Channel& operator=(const Channel&) = delete;
+        ~Channel() noexcept {
+            #if _TOPOSORT_UNIX
+                if (fd >= 0) ::close(fd);
+            #endif
+        }
+
+        void send(string& line) noexcept {
+            line += '\n';
+            const std::lock_guard lock(mutex);
+            if (fd < 0) {
+                std::cout.write(line.data(), static_cast<std::streamsize>(line.size()));
+                std::cout.flush();
+                return;
+            }
+            #if _TOPOSORT_UNIX
+                //连接已断开时丢弃回复
+                for (u64 sent = 0; sent < line.size();) {
+                    const ssize_t count = ::send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+                    if (count <= 0) return;
+                    sent += static_cast<u64>(count);
+                }
+            #endif
+        }
+    };
+
+    //常驻内存的培养方案服务：每行一个 JSON 请求，每个请求回复一行 JSON。
+    //修改已加载方案的请求（load、unload、带 commit 的 reschedule）在读取线程中立即执行，之后的请求一定能看到修改；
+    //其余请求进入有界队列由工作线程处理，回复可能不按请求顺序到达，调用方用 id 对应
+    class Server {
+        struct Outcome {
+            vector<vector<u32>> arrangements;
+            vector<Schedule> schedules;
+        };
+
+        struct Entry {
+            Curriculum curriculum;
+            //最近一次排课的结果，供 render 使用
+            std::mutex outcomeMutex;
+            shared_ptr<const Outcome> outcome;
+        };
+
+        struct Task {
+            shared_ptr<Channel> channel;
+            Json::Value request;
+        };
+
+        //一行请求的字节数上限，超过时回复错误并断开连接，避免不换行的客户端占用无限的内存
+        static constexpr u64 maxRequestBytes = 1 << 24;
+
+        RunOptions defaults;
+        std::shared_mutex storeMutex;
+        //修改已加载方案（load、unload、带 commit 的 reschedule）时从读取到替换全程持有，同名方案的修改不会互相覆盖
+        std::mutex commitMutex;
+        unordered_map<string, shared_ptr<Entry>> store;
+        BoundedQueue<Task> queue;
+        vector<std::thread> workers;
+        std::atomic<bool> stopping = false;
+        std::atomic<int> listener = -1;
+        //正在读取请求的套接字连接，停止时关闭其读端以结束读取；读取线程在连接结束后自行退出并从中移除
+        std::mutex connectionMutex;
+        std::condition_variable connectionsClosed;
+        vector<int> connections;
+
+        [[nodiscard]] shared_ptr<Entry> findEntry(const string& name) noexcept {
+            const std::shared_lock lock(storeMutex);
+            const auto it = store.find(name);
+            return it == store.end() ? nullptr : it->second;
+        }
+
+        void putEntry(const string& name, shared_ptr<Entry> entry) noexcept {
+            const std::unique_lock lock(storeMutex);
+            store[name] = move(entry);
+        }
+
+        [[nodiscard]] static string getString(const Json::Value& request, string_view key) noexcept {
+            const Json::Value* value = request.find(key);
+            return value != nullptr && value->type == Json::Value::Type::String ? value->text : string();
+        }
+
+        //数字字段必须是能放入 u32 的非负整数，小数和指数形式都不接受
+        [[nodiscard]] static bool getU32(const Json::Value& value, u32& result) noexcept {
+            if (value.type != Json::Value::Type::Number) return false;
+            const char* end = value.text.data() + value.text.size();
+            const auto [ptr, ec] = std::from_chars(value.text.data(), end, result);
+            return ec == std::errc() && ptr == end;
+        }
+
+        //reschedule 请求的 commit 为 true 时修改已加载的方案
+        [[nodiscard]] static bool isCommit(const Json::Value& request) noexcept {
+            const Json::Value* commit = request.find("commit");
+            return commit != nullptr && commit->type == Json::Value::Type::Boolean && commit->boolean;
+        }
+
+        //回复的开头，id 原样返回（缺少时为 null）
+        [[nodiscard]] static string beginReply(const Json::Value& request, bool ok) noexcept {
+            string reply = "{\"id\":";
+            const Json::Value* id = request.find("id");
+            if (id != nullptr && id->type == Json::Value::Type::String) renderJsonString(reply, id->text);
+            else if (id != nullptr && id->type == Json::Value::Type::Number) reply += id->text;
+            else reply += "null";
+            reply += ok ? ",\"ok\":true" : ",\"ok\":false";
+            return reply;
+        }
+
+        static void replyError(Channel& channel, const Json::Value& request, string_view error) noexcept {
+            string reply = beginReply(request, false);
+            reply += ",\"error\":";
+            renderJsonString(reply, error);
+            reply += '}';
+            channel.send(reply);
+        }
+
+        //请求中的 priority、format、exact、optimize、softSpread 覆盖启动时的设置
+        [[nodiscard]] bool getOptions(const Json::Value& request, RunOptions& options, string& error) const noexcept {
+            options = defaults;
+            const string priority = getString(request, "priority"), format = getString(request, "format");
+            if (priority == "file") options.priority = SchedulePriority::FileOrder;
+            else if (priority == "dependents") options.priority = SchedulePriority::MostDependents;
+            else if (priority == "credits") options.priority = SchedulePriority::FewestCredits;
+            else if (priority == "critical") options.priority = SchedulePriority::CriticalPath;
+            else if (!priority.empty()) {
+                error = "未知的优先顺序：" + priority;
+                return false;
+            }
+            if (format == "text") options.format = OutputFormat::Text;
+            else if (format == "json") options.format = OutputFormat::Json;
+            else if (format == "csv") options.format = OutputFormat::Csv;
+            else if (!format.empty()) {
+                error = "未知的输出格式：" + format;
+                return false;
+            }
+            for (const auto& [key, flag] : { pair<string_view, bool*>{ "exact", &options.placement.exact }, { "optimize", &options.placement.optimize } }) {
+                const Json::Value* value = request.find(key);
+                if (value != nullptr && value->type == Json::Value::Type::Boolean) *flag = value->boolean;
+            }
+            const Json::Value* softSpread = request.find("softSpread");
+            if (softSpread != nullptr && softSpread->type == Json::Value::Type::Boolean) options.placement.strictDaySpread = !softSpread->boolean;
+            return true;
+        }
+
+        //json 格式去掉换行（字符串中的换行已转义）后直接嵌入回复，text 与 csv 作为字符串
+        static void replyOutcome(Channel& channel, const Json::Value& request, const Curriculum& curriculum, const Outcome& outcome, OutputFormat format) noexcept {
+            string reply = beginReply(request, true), rendered;
+            renderResult(rendered, format, curriculum.courses, outcome.arrangements, outcome.schedules);
+            reply += ",\"result\":";
+            if (format == OutputFormat::Json) std::copy_if(rendered.begin(), rendered.end(), std::back_inserter(reply), [](char c) noexcept { return c != '\n'; });
+            else renderJsonString(reply, rendered);
+            reply += '}';
+            channel.send(reply);
+        }
+
+        [[nodiscard]] static string joinProblems(const vector<string>& problems) noexcept {
+            string error;
+            for (const string& problem : problems) error += (error.empty() ? "" : "\n") + problem;
+            return error;
+        }
+
+        [[nodiscard]] bool load(const string& name, const string& file, string& error) noexcept {
+            Result<Curriculum> curriculum = loadCurriculum(file, defaults.cacheDirectory);
+            if (!curriculum.ok()) {
+                error = curriculum.error;
+                return false;
+            }
+            const vector<string> problems = diagnoseCurriculum(curriculum.value);
+            if (!problems.empty()) {
+                error = joinProblems(problems);
+                return false;
+            }
+            const shared_ptr<Entry> entry = make_shared<Entry>();
+            entry->curriculum = move(curriculum.value);
+            const std::lock_guard lock(commitMutex);
+            putEntry(name, entry);
+            return true;
+        }
+
+        void schedule(Channel& channel, const Json::Value& request) noexcept {
+            const string name = getString(request, "name");
+            const shared_ptr<Entry> entry = findEntry(name);
+            if (entry == nullptr) return replyError(channel, request, "没有加载名为 " + name + " 的培养方案。");
+            RunOptions options;
+            string error;
+            if (!getOptions(request, options, error)) return replyError(channel, request, error);
+            const Curriculum& curriculum = entry->curriculum;
+            Result<vector<vector<u32>>> arrangements = sortCourses(curriculum.courses, curriculum.graph, curriculum.semesterLimits, options.priority);
+            if (!arrangements.ok()) return replyError(channel, request, arrangements.error);
+            Result<vector<Schedule>> schedules = getSchedules(curriculum.courses, arrangements.value, options.placement);
+            if (!schedules.ok()) return replyError(channel, request, schedules.error);
+            const shared_ptr<const Outcome> outcome = make_shared<const Outcome>(move(arrangements.value), move(schedules.value));
+            {
+                const std::lock_guard lock(entry->outcomeMutex);
+                entry->outcome = outcome;
+            }
+            replyOutcome(channel, request, curriculum, *outcome, options.format);
+        }
+
+        //在已加载方案的副本上应用 overrides 后重新排课；commit 为 true 时用修改后的方案替换原方案
+        void reschedule(Channel& channel, const Json::Value& request) noexcept {
+            std::unique_lock<std::mutex> commitLock;
+            if (isCommit(request)) commitLock = std::unique_lock(commitMutex);
+            const string name = getString(request, "name");
+            const shared_ptr<Entry> entry = findEntry(name);
+            if (entry == nullptr) return replyError(channel, request, "没有加载名为 " + name + " 的培养方案。");
+            RunOptions options;
+            string error;
+            if (!getOptions(request, options, error)) return replyError(channel, request, error);
+            IncrementalPlanner planner(entry->curriculum, options.priority, options.placement);
+            const Json::Value* overrides = request.find("overrides");
+            if (overrides != nullptr && overrides->type != Json::Value::Type::Array) return replyError(channel, request, "overrides 必须是数组。");
+            for (u64 i = 0; overrides != nullptr && i < overrides->items.size(); i++) {
+                const Json::Value& item = overrides->items[i];
+                const string type = getString(item, "type"), course = getString(item, "course"), prerequisite = getString(item, "prerequisite");
+                const Json::Value* semester = item.find("semester");
+                u32 semesterValue = 0;
+                if (semester != nullptr && !getU32(*semester, semesterValue)) return replyError(channel, request, "第 " + std::to_string(i + 1) + " 项修改的 semester 无效。");
+                Result<u32> result;
+                if (type == "pin") result = planner.pinCourse(course, semesterValue);
+                else if (type == "addPrerequisite") result = planner.addPrerequisite(course, prerequisite);
+                else if (type == "removePrerequisite") result = planner.removePrerequisite(course, prerequisite);
+                else if (type == "addCourse") {
+                    //课程字段在 addCourse 中复制到字符串池，这里只需在调用期间有效
+                    const string courseName = getString(item, "name");
+                    Course added = { .name = courseName, .code = course, .prerequisites = {}, .credit = 0, .semester = semesterValue };
+                    const Json::Value* credit = item.find("credit");
+                    if (credit == nullptr || !getU32(*credit, added.credit) || added.credit == 0) return replyError(channel, request, "第 " + std::to_string(i + 1) + " 项修改的 credit 无效。");
+                    const Json::Value* prerequisites = item.find("prerequisites");
+                    if (prerequisites != nullptr) {
+                        if (prerequisites->type != Json::Value::Type::Array) return replyError(channel, request, "第 " + std::to_string(i + 1) + " 项修改的 prerequisites 必须是数组。");
+                        for (const Json::Value& code : prerequisites->items) {
+                            if (code.type != Json::Value::Type::String) return replyError(channel, request, "第 " + std::to_string(i + 1) + " 项修改的 prerequisites 只能包含字符串。");
+                            added.prerequisites.push_back(code.text);
+                        }
+                    }
+                    result = planner.addCourse(move(added));
+                }
+                else return replyError(channel, request, "第 " + std::to_string(i + 1) + " 项修改的类型未知：" + type);
+                if (!result.ok()) return replyError(channel, request, "第 " + std::to_string(i + 1) + " 项修改失败：" + result.error);
+            }
+            const vector<string> problems = diagnoseCurriculum(planner.getCurriculum());
+            if (!problems.empty()) return replyError(channel, request, joinProblems(problems));
+            const Result<vector<vector<u32>>>& arrangements = planner.getArrangements();
+            if (!arrangements.ok()) return replyError(channel, request, arrangements.error);
+            const Result<vector<Schedule>>& schedules = planner.getSchedules();
+            if (!schedules.ok()) return replyError(channel, request, schedules.error);
+            const shared_ptr<const Outcome> outcome = make_shared<const Outcome>(arrangements.value, schedules.value);
+            if (isCommit(request)) {
+                const shared_ptr<Entry> updated = make_shared<Entry>();
+                updated->curriculum = planner.getCurriculum();
+                updated->outcome = outcome;
+                putEntry(name, updated);
+            }
+            replyOutcome(channel, request, planner.getCurriculum(), *outcome, options.format);
+        }
+
+        //按请求的格式重新输出最近一次排课的结果，不重新排课
+        void render(Channel& channel, const Json::Value& request) noexcept {
+            const string name = getString(request, "name");
+            const shared_ptr<Entry> entry = findEntry(name);
+            if (entry == nullptr) return replyError(channel, request, "没有加载名为 " + name + " 的培养方案。");
+            RunOptions options;
+            string error;
+            if (!getOptions(request, options, error)) return replyError(channel, request, error);
+            shared_ptr<const Outcome> outcome;
+            {
+                const std::lock_guard lock(entry->outcomeMutex);
+                outcome = entry->outcome;
+            }
+            if (outcome == nullptr) return replyError(channel, request, "培养方案 " + name + " 尚未排课。");
+            replyOutcome(channel, request, entry->curriculum, *outcome, options.format);
+        }
+
+        void work() noexcept {
+            Task task;
+            while (queue.pop(task)) {
+                const string op = getString(task.request, "op");
+                if (op == "schedule") schedule(*task.channel, task.request);
+                else if (op == "reschedule") reschedule(*task.channel, task.request);
+                else render(*task.channel, task.request);
+                task = {};
+            }
+        }
+
+        //处理一行请求，队列已关闭（服务正在停止）时返回 false
+        [[nodiscard]] bool handleLine(string_view line, const shared_ptr<Channel>& channel) noexcept {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+            if (line.empty()) return true;
+            Json::Value request;
+            Json::Parser parser(line);
+            if (!parser.parse(request) || request.type != Json::Value::Type::Object) {
+                replyError(*channel, request, "请求不是有效的 JSON 对象：" + parser.getError());
+                return true;
+            }
+            const string op = getString(request, "op");
+            if (op == "load") {
+                string error;
+                const string name = getString(request, "name"), file = getString(request, "path");
+                if (name.empty() || file.empty()) replyError(*channel, request, "load 请求需要 name 与 path。");
+                else if (!load(name, file, error)) replyError(*channel, request, error);
+                else {
+                    string reply = beginReply(request, true) + ",\"courses\":" + std::to_string(findEntry(name)->curriculum.courses.size()) + '}';
+                    channel->send(reply);
+                }
+            }
+            else if (op == "unload") {
+                bool erased;
+                {
+                    const std::lock_guard commitLock(commitMutex);
+                    const std::unique_lock lock(storeMutex);
+                    erased = store.erase(getString(request, "name")) != 0;
+                }
+                if (erased) {
+                    string reply = beginReply(request, true) + '}';
+                    channel->send(reply);
+                }
+                else replyError(*channel, request, "没有加载名为 " + getString(request, "name") + " 的培养方案。");
+            }
+            else if (op == "list") {
+                string reply = beginReply(request, true) + ",\"curricula\":[";
+                {
+                    const std::shared_lock lock(storeMutex);
+                    bool first = true;
+                    for (const auto& [name, entry] : store) {
+                        reply += first ? "{\"name\":" : ",{\"name\":";
+                        renderJsonString(reply, name);
+                        reply += ",\"courses\":" + std::to_string(entry->curriculum.courses.size()) + '}';
+                        first = false;
+                    }
+                }
+                reply += "]}";
+                channel->send(reply);
+            }
+            else if (op == "shutdown") {
+                string reply = beginReply(request, true) + '}';
+                channel->send(reply);
+                stop();
+                return false;
+            }
+            else if (op == "reschedule" && isCommit(request)) reschedule(*channel, request);
+            else if (op == "schedule" || op == "reschedule" || op == "render") {
+                if (!queue.push({ .channel = channel, .request = move(request) })) return false;
+            }
+            else replyError(*channel, request, "未知的请求类型：" + op);
+            return true;
+        }
+
+        //从 fd（-1 表示标准输入）逐行读取请求直到结束、服务停止或请求过长
+        void serveStream(int fd, const shared_ptr<Channel>& channel) noexcept {
+            #if _TOPOSORT_UNIX
+                if (fd < 0) fd = STDIN_FILENO;
+                string buffer;
+                char chunk[1 << 14];
+                while (!stopping) {
+                    const ssize_t count = ::read(fd, chunk, sizeof(chunk));
+                    if (count < 0 && errno == EINTR) continue;
+                    if (count <= 0) break;
+                    buffer.append(chunk, static_cast<u64>(count));
+                    u64 start = 0;
+                    for (u64 end = buffer.find('\n'); end != string::npos; end = buffer.find('\n', start)) {
+                        if (end - start > maxRequestBytes) break;
+                        if (!handleLine(string_view(buffer).substr(start, end - start), channel)) return;
+                        start = end + 1;
+                    }
+                    buffer.erase(0, start);
+                    if (buffer.size() > maxRequestBytes) {
+                        replyError(*channel, Json::Value(), "请求超过 " + std::to_string(maxRequestBytes) + " 字节，连接已关闭。");
+                        return;
+                    }
+                }
+                //最后一行可以没有换行
+                if (!stopping && !buffer.empty()) (void)handleLine(buffer, channel);
+            #else
+                string line;
+                while (!stopping && std::getline(std::cin, line)) if (!handleLine(line, channel)) break;
+                (void)fd;
+            #endif
+        }
+
+    public:
+        //threadCount 为处理排课请求的工作线程数（0 表示硬件并发数），queueSize 为等待处理的请求数上限
+        [[nodiscard]] explicit Server(const RunOptions& defaults, u32 threadCount, u64 queueSize) noexcept : defaults(defaults), queue(queueSize) {
+            if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+            for (u32 i = 0; i < threadCount; i++) {
+                try { workers.emplace_back([this] { work(); }); } catch (...) { break; }
+            }
+        }
+
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+        ~Server() noexcept {
+            stop();
+            for (std::thread& worker : workers) worker.join();
+        }
+
+        //启动时预先加载，name 为之后请求中使用的名称
+        [[nodiscard]] bool preload(const string& name, const string& file, string& error) noexcept { return load(name, file, error); }
+
+        //停止接受新请求，已在队列中的请求处理完后工作线程退出
+        void stop() noexcept {
+            stopping = true;
+            queue.close();
+            #if _TOPOSORT_UNIX
+                const int fd = listener.exchange(-1);
+                if (fd >= 0) ::shutdown(fd, SHUT_RDWR);
+            #endif
+        }
+
+        //从标准输入读取请求、向标准输出写回复，直到输入结束或收到 shutdown
+        void serveStdio() noexcept {
+            serveStream(-1, make_shared<Channel>());
+            stop();
+        }
+
+        //监听 Unix 域套接字，每个连接由单独的线程读取请求，直到收到 shutdown
+        [[nodiscard]] bool serveSocket(const string& socketPath, string& error) noexcept {
+            #if _TOPOSORT_UNIX
+                sockaddr_un address{};
+                address.sun_family = AF_UNIX;
+                if (socketPath.size() >= sizeof(address.sun_path)) {
+                    error = "套接字路径过长：" + socketPath;
+                    return false;
+                }
+                std::memcpy(address.sun_path, socketPath.data(), socketPath.size());
+                const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                if (fd < 0) {
+                    error = "无法创建套接字。";
+                    return false;
+                }
+                std::error_code ec;
+                std::filesystem::remove(socketPath, ec);
+                if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 64) != 0) {
+                    ::close(fd);
+                    error = "无法监听套接字：" + socketPath;
+                    return false;
+                }
+                listener = fd;
+                while (!stopping) {
+                    const int client = ::accept(fd, nullptr, nullptr);
+                    if (client < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED) continue;
+                        break;
+                    }
+                    {
+                        const std::lock_guard lock(connectionMutex);
+                        connections.push_back(client);
+                    }
+                    //回复通道由排队中的请求共同持有，最后一个请求处理完后才关闭连接
+                    const shared_ptr<Channel> channel = make_shared<Channel>(client);
+                    try {
+                        std::thread([this, client, channel] {
+                            serveStream(client, channel);
+                            //持有锁时通知，等待的一方返回后本线程不再访问服务对象
+                            const std::lock_guard lock(connectionMutex);
+                            std::erase(connections, client);
+                            connectionsClosed.notify_all();
+                        }).detach();
+                    }
+                    catch (...) {
+                        const std::lock_guard lock(connectionMutex);
+                        std::erase(connections, client);
+                    }
+                }
+                stop();
+                ::close(fd);
+                std::filesystem::remove(socketPath, ec);
+                std::unique_lock lock(connectionMutex);
+                for (const int client : connections) ::shutdown(client, SHUT_RD);
+                connectionsClosed.wait(lock, [this] { return connections.empty(); });
+                return true;
+            #else
+                error = "此平台不支持 Unix 域套接字，请使用标准输入输出。";
+                (void)socketPath;
+                return false;
+            #endif
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,270 @@
+﻿#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "stats.hpp"
+#include "toposort.hpp"
+#include "utils.hpp"
+
+namespace Toposort {
+    using std::string, std::string_view, std::vector, std::unordered_map, std::filesystem::path, Utils::MappedFile, Utils::Result, Utils::normalize;
+
+    //快照文件由固定长度的文件头、依次排列的 u32 数组和字符串池组成，数组之间只靠文件头中的长度定位，
+    //不含指针，复制到别处或直接映射都可以使用。字节序或版本不符时视为无效快照
+    inline constexpr string_view snapshotMagic("TOPOSNAP", 8);
+    inline constexpr u32 snapshotVersion = 1, snapshotByteOrder = 0x01020304;
+
+    struct SnapshotHeader {
+        char magic[8];
+        u32 version, byteOrder;
+        //生成快照的输入文件内容的哈希与长度，用于缓存校验
+        u64 sourceHash, sourceSize;
+        u32 courseCount, semesterCount, edgeCount, prerequisiteCount, danglingCount, stringCount;
+        u64 stringBytes;
+    };
+
+    static_assert(sizeof(SnapshotHeader) == 64 && std::is_trivially_copyable_v<SnapshotHeader>);
+
+    //输入内容的 64 位哈希（非加密），作为快照缓存的键
+    [[nodiscard]] inline u64 hashContent(string_view content) noexcept {
+        const auto mix = [](u64 hash, u64 word) noexcept { return std::rotl(hash ^ (word * 0x9E3779B97F4A7C15ull), 31) * 0xBF58476D1CE4E5B9ull; };
+        u64 hash = content.size(), i = 0, word;
+        for (; i + 8 <= content.size(); i += 8) {
+            std::memcpy(&word, content.data() + i, 8);
+            hash = mix(hash, word);
+        }
+        if (i < content.size()) {
+            word = 0;
+            std::memcpy(&word, content.data() + i, content.size() - i);
+            hash = mix(hash, word);
+        }
+        hash ^= hash >> 31;
+        hash *= 0x94D049BB133111EBull;
+        return hash ^ (hash >> 29);
+    }
+
+    //将培养方案写成快照，课程代码、课程名称与先修课程代码共用同一个去重的字符串池
+    inline void writeSnapshot(string& out, const Curriculum& curriculum, u64 sourceHash, u64 sourceSize) noexcept {
+        const vector<Course>& courses = curriculum.courses;
+        const CourseGraph& graph = curriculum.graph;
+        const u32 courseCount = static_cast<u32>(courses.size());
+        unordered_map<string_view, u32> stringIds;
+        vector<string_view> strings;
+        const auto intern = [&](string_view text) noexcept {
+            const auto [it, inserted] = stringIds.try_emplace(text, static_cast<u32>(strings.size()));
+            if (inserted) strings.push_back(text);
+            return it->second;
+        };
+        vector<u32> credits(courseCount), semesters(courseCount), codes(courseCount), names(courseCount), prerequisiteOffsets(courseCount + 1, 0), prerequisites, dangling;
+        for (u32 i = 0; i < courseCount; i++) {
+            credits[i] = courses[i].credit;
+            semesters[i] = courses[i].semester;
+            codes[i] = intern(courses[i].code);
+            names[i] = intern(courses[i].name);
+            for (const string_view prerequisite : courses[i].prerequisites) prerequisites.push_back(intern(prerequisite));
+            prerequisiteOffsets[i + 1] = static_cast<u32>(prerequisites.size());
+        }
+        for (const auto& [course, index] : graph.danglingReferences) {
+            dangling.push_back(course);
+            dangling.push_back(index);
+        }
+        vector<u32> stringOffsets(strings.size() + 1, 0);
+        for (u64 i = 0; i < strings.size(); i++) stringOffsets[i + 1] = stringOffsets[i] + static_cast<u32>(strings[i].size());
+        const SnapshotHeader header = {
+            .magic = { 'T', 'O', 'P', 'O', 'S', 'N', 'A', 'P' }, .version = snapshotVersion, .byteOrder = snapshotByteOrder, .sourceHash = sourceHash, .sourceSize = sourceSize,
+            .courseCount = courseCount, .semesterCount = static_cast<u32>(curriculum.semesterLimits.size()), .edgeCount = static_cast<u32>(graph.dependents.size()),
+            .prerequisiteCount = static_cast<u32>(prerequisites.size()), .danglingCount = static_cast<u32>(graph.danglingReferences.size()), .stringCount = static_cast<u32>(strings.size()),
+            .stringBytes = stringOffsets.back()
+        };
+        out.clear();
+        out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const vector<u32>* array : std::initializer_list<const vector<u32>*>{ &curriculum.semesterLimits, &credits, &semesters, &codes, &names, &prerequisiteOffsets, &prerequisites, &graph.offsets, &graph.dependents, &graph.inDegree, &dangling, &stringOffsets }) {
+            if (!array->empty()) out.append(reinterpret_cast<const char*>(array->data()), array->size() * sizeof(u32));
+        }
+        for (const string_view text : strings) out += text;
+    }
+
+    [[nodiscard]] inline bool isSnapshot(string_view content) noexcept { return content.starts_with(snapshotMagic); }
+
+    //读取并校验快照文件头，整个文件的长度必须与文件头中的各项长度一致
+    [[nodiscard]] inline bool readSnapshotHeader(string_view content, SnapshotHeader& header, string& error) noexcept {
+        if (content.size() < sizeof(SnapshotHeader) || !isSnapshot(content)) {
+            error = "不是有效的快照文件。";
+            return false;
+        }
+        std::memcpy(&header, content.data(), sizeof(header));
+        if (header.version != snapshotVersion || header.byteOrder != snapshotByteOrder) {
+            error = "快照文件的版本或字节序不受支持，请用原始输入文件重新生成。";
+            return false;
+        }
+        //各项长度都来自文件，分别与剩余的字节数比较，不做可能溢出的求和；通过后 readSnapshot 中的每个数组都在文件范围内
+        const u64 words = u64(header.semesterCount) + 4ull * header.courseCount + 2ull * (header.courseCount + 1ull) + header.prerequisiteCount + header.edgeCount + header.courseCount + 2ull * header.danglingCount + header.stringCount + 1ull;
+        const u64 remaining = content.size() - sizeof(SnapshotHeader);
+        if (words > remaining / sizeof(u32) || header.stringBytes != remaining - words * sizeof(u32)) {
+            error = "快照文件已损坏。";
+            return false;
+        }
+        return true;
+    }
+
+    //从快照内容还原培养方案，不需要解析文本或重新建立先修关系图；content 通常是映射到内存的快照文件。
+    //这是基于复制的读取：各数组逐块复制到培养方案的 vector 中，字符串区整体复制到字符串池一次，
+    //每门课程的先修列表重新建立，返回后 content 不再被引用，映射可以立即关闭
+    [[nodiscard]] inline Result<Curriculum> readSnapshot(string_view content) noexcept {
+        const Stats::Span span(Stats::Phase::Parse);
+        SnapshotHeader header;
+        string error;
+        if (!readSnapshotHeader(content, header, error)) return { .error = error };
+        Result<Curriculum> result;
+        Curriculum& curriculum = result.value;
+        CourseGraph& graph = curriculum.graph;
+        const u32 courseCount = header.courseCount;
+        const char* cursor = content.data() + sizeof(SnapshotHeader);
+        const auto take = [&](vector<u32>& array, u64 count) noexcept {
+            array.resize(count);
+            if (count != 0) std::memcpy(array.data(), cursor, count * sizeof(u32));
+            cursor += count * sizeof(u32);
+        };
+        vector<u32> credits, semesters, codes, names, prerequisiteOffsets, prerequisites, dangling, stringOffsets;
+        take(curriculum.semesterLimits, header.semesterCount);
+        take(credits, courseCount);
+        take(semesters, courseCount);
+        take(codes, courseCount);
+        take(names, courseCount);
+        take(prerequisiteOffsets, courseCount + 1ull);
+        take(prerequisites, header.prerequisiteCount);
+        take(graph.offsets, courseCount + 1ull);
+        take(graph.dependents, header.edgeCount);
+        take(graph.inDegree, courseCount);
+        take(dangling, 2ull * header.danglingCount);
+        take(stringOffsets, header.stringCount + 1ull);
+        const string_view bytes(cursor, header.stringBytes);
+        //下标与偏移都在范围内且单调，之后的访问不再检查
+        const auto monotonic = [](const vector<u32>& offsets, u64 last) noexcept {
+            if (offsets.front() != 0 || offsets.back() != last) return false;
+            for (u64 i = 1; i < offsets.size(); i++) if (offsets[i] < offsets[i - 1]) return false;
+            return true;
+        };
+        const auto below = [](const vector<u32>& ids, u64 limit) noexcept { return std::all_of(ids.begin(), ids.end(), [&](u32 id) noexcept { return id < limit; }); };
+        bool valid = monotonic(stringOffsets, header.stringBytes) && monotonic(prerequisiteOffsets, header.prerequisiteCount) && monotonic(graph.offsets, header.edgeCount)
+            && below(codes, header.stringCount) && below(names, header.stringCount) && below(prerequisites, header.stringCount) && below(graph.dependents, courseCount);
+        valid = valid && std::find(credits.begin(), credits.end(), 0) == credits.end();
+        if (valid) {
+            vector<u32> inDegree(courseCount, 0);
+            for (const u32 dependent : graph.dependents) inDegree[dependent]++;
+            valid = inDegree == graph.inDegree;
+        }
+        for (u32 i = 0; valid && i < header.danglingCount; i++) valid = dangling[2 * i] < courseCount && dangling[2 * i + 1] < prerequisiteOffsets[dangling[2 * i] + 1] - prerequisiteOffsets[dangling[2 * i]];
+        if (!valid) return { .error = "快照文件已损坏。" };
+        //与解析文本输入时对第一行的检查相同
+        if (!checkSemesterLimits(curriculum.semesterLimits, error) || !checkCourseCount(curriculum.semesterLimits, courseCount, error)) return { .error = error };
+        //字符串区整体复制到培养方案的字符串池中一次，课程字段指向其中的片段
+        const string_view pool = curriculum.strings->store(bytes);
+        const auto text = [&](u32 id) noexcept { return pool.substr(stringOffsets[id], stringOffsets[id + 1] - stringOffsets[id]); };
+        curriculum.courses.resize(courseCount);
+        for (u32 i = 0; i < courseCount; i++) {
+            Course& course = curriculum.courses[i];
+            course.name = text(names[i]);
+            course.code = text(codes[i]);
+            course.credit = credits[i];
+            course.semester = semesters[i];
+            course.prerequisites.reserve(prerequisiteOffsets[i + 1] - prerequisiteOffsets[i]);
+            for (u32 j = prerequisiteOffsets[i]; j < prerequisiteOffsets[i + 1]; j++) course.prerequisites.push_back(text(prerequisites[j]));
+        }
+        graph.danglingReferences.resize(header.danglingCount);
+        for (u32 i = 0; i < header.danglingCount; i++) graph.danglingReferences[i] = { dangling[2 * i], dangling[2 * i + 1] };
+        Stats::add(Stats::Counter::Courses, courseCount);
+        Stats::add(Stats::Counter::Edges, header.edgeCount);
+        return result;
+    }
+
+    //先写入临时文件再改名，多个进程或线程同时写同一个快照时读者不会看到不完整的文件；
+    //临时文件名含进程号与线程号，同时写入的进程与线程各用各的临时文件
+    [[nodiscard]] inline bool saveSnapshot(const path& file, const string& snapshot, string& error) noexcept {
+        #if _TOPOSORT_WINDOWS
+            const u64 process = GetCurrentProcessId();
+        #else
+            const u64 process = static_cast<u64>(::getpid());
+        #endif
+        path temporary = file;
+        temporary += ".tmp" + std::to_string(process) + "-" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream output(temporary, std::ios::out | std::ios::binary);
+            if (!output.is_open()) {
+                error = "无法写入快照文件：" + string(STR(file));
+                return false;
+            }
+            output.write(snapshot.data(), static_cast<std::streamsize>(snapshot.size()));
+            if (!output) {
+                error = "无法写入快照文件：" + string(STR(file));
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temporary, file, ec);
+        if (ec) {
+            std::filesystem::remove(temporary, ec);
+            error = "无法写入快照文件：" + string(STR(file));
+            return false;
+        }
+        return true;
+    }
+
+    //读取培养方案：输入本身是快照时直接还原；cacheDirectory 非空时以输入内容的哈希为键在其中查找快照，
+    //命中则跳过解析，未命中则解析后写入快照（写入失败不影响本次结果）
+    [[nodiscard]] inline Result<Curriculum> loadCurriculum(const string& filePathStr, const string& cacheDirectory) noexcept {
+        Stats::Span span(Stats::Phase::Parse);
+        path filePath(filePathStr);
+        if (!normalize(filePath)) {
+            return { .error = "无法规范化文件路径：" + filePathStr };
+        }
+        MappedFile file;
+        if (!file.open(filePath)) {
+            return { .error = "无法打开文件：" + filePath.string() };
+        }
+        const string_view content = file.view();
+        span.stop();
+        if (isSnapshot(content)) return readSnapshot(content);
+        if (cacheDirectory.empty()) return parseCurriculum(content);
+        Stats::Span lookupSpan(Stats::Phase::Parse);
+        const u64 hash = hashContent(content);
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.tpsnap", static_cast<unsigned long long>(hash));
+        const path cacheFile = path(cacheDirectory) / name;
+        string error;
+        {
+            MappedFile cached;
+            SnapshotHeader header;
+            if (cached.open(cacheFile) && readSnapshotHeader(cached.view(), header, error) && header.sourceHash == hash && header.sourceSize == content.size()) {
+                lookupSpan.stop();
+                Result<Curriculum> result = readSnapshot(cached.view());
+                if (result.ok()) {
+                    Stats::add(Stats::Counter::SnapshotHits, 1);
+                    return result;
+                }
+            }
+        }
+        lookupSpan.stop();
+        Result<Curriculum> result = parseCurriculum(content);
+        if (!result.ok()) return result;
+        const Stats::Span saveSpan(Stats::Phase::Write);
+        string snapshot;
+        writeSnapshot(snapshot, result.value, hash, content.size());
+        std::error_code ec;
+        std::filesystem::create_directories(cacheDirectory, ec);
+        (void)saveSnapshot(cacheFile, snapshot, error);
+        return result;
+    }
+}
\ No newline at end of file
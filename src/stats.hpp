@@ -0,0 +1,193 @@
+﻿#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//为 0 时去掉所有计时与计数，相关调用都成为空操作
+#ifndef TOPOSORT_STATS
+    #define TOPOSORT_STATS 1
+#endif
+
+namespace Toposort::Stats {
+    typedef uint8_t u8;
+    typedef uint32_t u32;
+    typedef uint64_t u64;
+    using std::array, std::string, std::string_view, std::vector, std::filesystem::path;
+
+    enum class Phase : u8 {
+        Parse,
+        Graph,
+        Analyze,
+        Assign,
+        Place,
+        Render,
+        Write,
+    };
+
+    inline constexpr u8 phaseCount = 7;
+    inline constexpr array<string_view, phaseCount> phaseKeys = { "parse", "graph", "analyze", "assign", "place", "render", "write" };
+    inline constexpr array<string_view, phaseCount> phaseNames = { "读取与解析", "建立先修关系图", "先修关系检查", "学期安排", "课表排课", "输出渲染", "写入文件" };
+
+    enum class Counter : u8 {
+        Courses,
+        Edges,
+        Semesters,
+        //贪心排课检查过的候选位置数
+        Candidates,
+        //候选位置都不可用、退回到整张课表扫描的次数
+        FallbackScans,
+        //整张课表也放不下的次数
+        FailedPlacements,
+        ExactSearches,
+        ExactNodes,
+        //从快照缓存读取、跳过解析的输入数
+        SnapshotHits,
+    };
+
+    inline constexpr u8 counterCount = 9;
+    inline constexpr array<string_view, counterCount> counterKeys = { "courses", "edges", "semesters", "candidates", "fallbackScans", "failedPlacements", "exactSearches", "exactNodes", "snapshotHits" };
+    inline constexpr array<string_view, counterCount> counterNames = { "课程数", "先修关系数", "排课学期数", "尝试的候选位置", "整表扫描次数", "放置失败次数", "精确搜索次数", "精确搜索节点数", "快照缓存命中" };
+
+#if TOPOSORT_STATS
+    inline constexpr bool enabled = true;
+    //各阶段的累计耗时（纳秒），多线程时为各线程之和
+    inline array<std::atomic<u64>, phaseCount> phaseNanoseconds{};
+    inline array<std::atomic<u64>, counterCount> counters{};
+    inline std::atomic<bool> tracing = false;
+
+    struct TraceEvent {
+        Phase phase;
+        u32 thread;
+        u64 start, duration;
+    };
+
+    inline std::mutex traceMutex;
+    inline vector<TraceEvent> traceEvents;
+    inline const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    inline void add(Counter counter, u64 value) noexcept { counters[static_cast<u8>(counter)].fetch_add(value, std::memory_order_relaxed); }
+
+    [[nodiscard]] inline u32 getThreadId() noexcept {
+        static std::atomic<u32> nextId = 0;
+        thread_local const u32 id = nextId.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    //计时区间，析构或调用 stop 时计入对应阶段，开启跟踪时同时记录一条事件
+    class Span {
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+        bool running = true;
+
+    public:
+        [[nodiscard]] explicit Span(Phase phase) noexcept : phase(phase), start(std::chrono::steady_clock::now()) {}
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+        ~Span() noexcept { stop(); }
+
+        void stop() noexcept {
+            if (!running) return;
+            running = false;
+            const auto end = std::chrono::steady_clock::now();
+            const u64 duration = static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            phaseNanoseconds[static_cast<u8>(phase)].fetch_add(duration, std::memory_order_relaxed);
+            if (!tracing.load(std::memory_order_relaxed)) return;
+            const u64 offset = static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - startTime).count());
+            const std::lock_guard lock(traceMutex);
+            traceEvents.push_back({ phase, getThreadId(), offset, duration });
+        }
+    };
+
+    //在热点循环中先累加到局部变量，离开作用域时一次性计入
+    struct Tally {
+        Counter counter;
+        u64 value = 0;
+
+        [[nodiscard]] explicit Tally(Counter counter) noexcept : counter(counter) {}
+        Tally(const Tally&) = delete;
+        Tally& operator=(const Tally&) = delete;
+        ~Tally() noexcept { if (value != 0) add(counter, value); }
+    };
+
+    inline void startTrace() noexcept { tracing.store(true, std::memory_order_relaxed); }
+
+    [[nodiscard]] inline string report(bool json) noexcept {
+        string result;
+        char number[32];
+        if (json) {
+            result += "{\"phases\":{";
+            for (u8 i = 0; i < phaseCount; i++) {
+                std::snprintf(number, sizeof(number), "%.3f", static_cast<double>(phaseNanoseconds[i].load()) / 1e6);
+                result += (i > 0 ? ",\"" : "\"") + string(phaseKeys[i]) + "\":" + number;
+            }
+            result += "},\"counters\":{";
+            for (u8 i = 0; i < counterCount; i++) result += (i > 0 ? ",\"" : "\"") + string(counterKeys[i]) + "\":" + std::to_string(counters[i].load());
+            result += "}}";
+            return result;
+        }
+        result += "阶段耗时（毫秒，多线程时为各线程之和）：\n";
+        for (u8 i = 0; i < phaseCount; i++) {
+            std::snprintf(number, sizeof(number), "%.3f", static_cast<double>(phaseNanoseconds[i].load()) / 1e6);
+            result += "  " + string(phaseNames[i]) + "：" + number + '\n';
+        }
+        result += "计数：\n";
+        for (u8 i = 0; i < counterCount; i++) result += "  " + string(counterNames[i]) + "：" + std::to_string(counters[i].load()) + (i + 1 < counterCount ? "\n" : "");
+        return result;
+    }
+
+    //写出 Chrome 跟踪格式（chrome://tracing 或 Perfetto 可以打开），时间单位为微秒
+    [[nodiscard]] inline bool writeTrace(const path& file, string& error) noexcept {
+        std::ofstream output(file, std::ios::out | std::ios::binary);
+        if (!output.is_open()) {
+            error = "无法打开跟踪文件：" + file.string();
+            return false;
+        }
+        const std::lock_guard lock(traceMutex);
+        char buffer[160];
+        output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        for (u64 i = 0; i < traceEvents.size(); i++) {
+            const TraceEvent& event = traceEvents[i];
+            std::snprintf(buffer, sizeof(buffer), "%s\n{\"name\":\"%s\",\"cat\":\"toposort\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", i > 0 ? "," : "", phaseKeys[static_cast<u8>(event.phase)].data(), event.thread, static_cast<double>(event.start) / 1e3, static_cast<double>(event.duration) / 1e3);
+            output << buffer;
+        }
+        output << "\n]}";
+        if (!output) {
+            error = "无法写入跟踪文件：" + file.string();
+            return false;
+        }
+        return true;
+    }
+#else
+    inline constexpr bool enabled = false;
+
+    inline void add(Counter, u64) noexcept {}
+
+    class Span {
+    public:
+        [[nodiscard]] explicit Span(Phase) noexcept {}
+        void stop() noexcept {}
+    };
+
+    struct Tally {
+        u64 value = 0;
+
+        [[nodiscard]] explicit Tally(Counter) noexcept {}
+    };
+
+    inline void startTrace() noexcept {}
+
+    [[nodiscard]] inline string report(bool) noexcept { return {}; }
+
+    [[nodiscard]] inline bool writeTrace(const path&, string& error) noexcept {
+        error = "此版本编译时未启用统计功能。";
+        return false;
+    }
+#endif
+}
\ No newline at end of file
@@ -1,301 +1,922 @@
 ﻿#pragma once
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
 #include <filesystem>
-#include <fstream>
+#include <memory>
+#include <memory_resource>
 #include <queue>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "stats.hpp"
 #include "utils.hpp"
 
 namespace Toposort {
+    typedef uint8_t u8;
+    typedef uint16_t u16;
     typedef uint32_t u32;
     typedef uint64_t u64;
-    using std::array, std::pair, std::string, std::vector, std::ifstream, std::filesystem::path, std::istringstream, std::stoul, std::move, std::to_string, std::queue, std::unordered_map, std::unordered_set, std::getline, Utils::normalize, Utils::setError;
+    using std::array, std::pair, std::string, std::string_view, std::vector, std::filesystem::path, std::from_chars, std::errc, std::move, std::to_string, std::queue, std::unordered_map, std::unordered_set, Utils::MappedFile, Utils::StringPool, Utils::ScratchArena, Utils::nextField, Utils::parseU32, Utils::Result, Utils::normalize;
 
+    //课程代码、名称与先修课程代码都指向所属培养方案的字符串池
     struct Course {
-        string name, code;
-        vector<string> prerequisites;
+        string_view name, code;
+        vector<string_view> prerequisites;
         u32 credit, semester;
     };
 
-    [[nodiscard]] inline bool loadInfoFromFile(const string& filePathStr, vector<Course>& courses, vector<u32>& semesterLimits) noexcept {
-        path filePath(filePathStr);
-        if (!normalize(filePath)) {
-            setError("无法规范化文件路径：" + filePathStr);
+    //以压缩稀疏行（CSR）形式保存的先修关系，课程以其在 courses 中的下标作为编号
+    struct CourseGraph {
+        //课程 i 的后续课程为 dependents[offsets[i]] 到 dependents[offsets[i + 1]] 之间的元素
+        vector<u32> offsets, dependents, inDegree;
+        //找不到的先修课程代码，元素为（课程编号，该课程先修列表中的下标）
+        vector<pair<u32, u32>> danglingReferences;
+
+        [[nodiscard]] u32 size() const noexcept { return static_cast<u32>(inDegree.size()); }
+    };
+
+    //一份培养方案：课程信息、先修关系图以及各学期的课程数上限；复制时与原方案共享字符串池
+    struct Curriculum {
+        vector<Course> courses;
+        CourseGraph graph;
+        vector<u32> semesterLimits;
+        std::shared_ptr<StringPool> strings = std::make_shared<StringPool>();
+    };
+
+    //将课程代码映射为编号并建立先修关系图，未知的先修课程代码不进入图中，记录在 danglingReferences 里
+    inline void buildCourseGraph(const vector<Course>& courses, CourseGraph& graph) noexcept {
+        const Stats::Span span(Stats::Phase::Graph);
+        const ScratchArena::Scope scratch;
+        const u32 courseCount = static_cast<u32>(courses.size());
+        std::pmr::unordered_map<string_view, u32> courseIndex(scratch.resource());
+        courseIndex.reserve(courseCount);
+        for (u32 i = 0; i < courseCount; i++) courseIndex[courses[i].code] = i;
+        std::pmr::vector<u32> prerequisiteIds(scratch.resource());
+        std::pmr::vector<u32> prerequisiteOffsets(courseCount + 1, 0, scratch.resource());
+        graph.offsets.assign(courseCount + 1, 0);
+        graph.inDegree.assign(courseCount, 0);
+        graph.danglingReferences.clear();
+        for (u32 i = 0; i < courseCount; i++) {
+            for (u32 j = 0; j < courses[i].prerequisites.size(); j++) {
+                const auto it = courseIndex.find(courses[i].prerequisites[j]);
+                if (it == courseIndex.end()) {
+                    graph.danglingReferences.emplace_back(i, j);
+                    continue;
+                }
+                prerequisiteIds.push_back(it->second);
+                graph.offsets[it->second + 1]++;
+                graph.inDegree[i]++;
+            }
+            prerequisiteOffsets[i + 1] = static_cast<u32>(prerequisiteIds.size());
+        }
+        for (u32 i = 0; i < courseCount; i++) graph.offsets[i + 1] += graph.offsets[i];
+        graph.dependents.resize(prerequisiteIds.size());
+        std::pmr::vector<u32> cursor(graph.offsets.begin(), graph.offsets.end() - 1, scratch.resource());
+        for (u32 i = 0; i < courseCount; i++) for (u32 j = prerequisiteOffsets[i]; j < prerequisiteOffsets[i + 1]; j++) graph.dependents[cursor[prerequisiteIds[j]]++] = i;
+        Stats::add(Stats::Counter::Courses, courseCount);
+        Stats::add(Stats::Counter::Edges, graph.dependents.size());
+    }
+
+    //逐行切分文件内容，去掉行尾的 \r 以兼容 CRLF 文件
+    [[nodiscard]] inline bool nextLine(string_view content, u64& pos, string_view& line) noexcept {
+        if (!nextField(content, pos, '\n', line)) return false;
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        return true;
+    }
+
+    //第一行的学期课程数：至少有一个学期，且学期数为偶数
+    [[nodiscard]] inline bool checkSemesterLimits(const vector<u32>& semesterLimits, string& error) noexcept {
+        if (semesterLimits.empty()) {
+            error = "第一行没有有效的学期课程数。";
             return false;
         }
-        ifstream file(filePath, std::ios::in);
-        if (!file.is_open()) {
-            setError("无法打开文件：" + filePath.string());
+        if (semesterLimits.size() & 1) {
+            error = "学期数必须为偶数。";
             return false;
         }
+        return true;
+    }
+
+    //各学期课程数之和必须等于课程总数
+    [[nodiscard]] inline bool checkCourseCount(const vector<u32>& semesterLimits, u64 courseCount, string& error) noexcept {
+        u64 total = 0;
+        for (const u32 limit : semesterLimits) total += limit;
+        if (total != courseCount) {
+            error = "课程数量与第一行指定的总课程数不符。";
+            return false;
+        }
+        return true;
+    }
+
+    //解析输入文件的内容并建立先修关系图；内容整体复制到字符串池中，课程的各个字段直接指向其中的片段
+    [[nodiscard]] inline Result<Curriculum> parseCurriculum(string_view source) noexcept {
+        Stats::Span span(Stats::Phase::Parse);
+        Result<Curriculum> result;
+        const string_view content = result.value.strings->store(source);
+        vector<Course>& courses = result.value.courses;
+        vector<u32>& semesterLimits = result.value.semesterLimits;
+        u64 pos = 0;
         u32 totalCourses = 0;
-        string temp1;
+        string_view line;
         {
-            if (!getline(file, temp1)) {
-                setError("无法读取文件第一行。");
-                return false;
+            if (!nextLine(content, pos, line)) {
+                return { .error = "无法读取文件第一行。" };
             }
-            istringstream iss(temp1);
-            u32 count;
-            while (iss >> count) {
+            const char* cursor = line.data(), * const lineEnd = line.data() + line.size();
+            while (true) {
+                while (cursor < lineEnd && (*cursor == ' ' || (*cursor >= '\t' && *cursor <= '\r'))) cursor++;
+                u32 count;
+                const auto [ptr, ec] = from_chars(cursor, lineEnd, count);
+                if (ec != errc()) break;
                 semesterLimits.push_back(count);
                 totalCourses += count;
+                cursor = ptr;
             }
-            if (semesterLimits.empty()) {
-                setError("第一行没有有效的学期课程数。");
-                return false;
-            }
-            if (semesterLimits.size() & 1) {
-                setError("学期数必须为偶数。");
-                return false;
-            }
+            string error;
+            if (!checkSemesterLimits(semesterLimits, error)) return { .error = error };
         }
-        string name, code, temp2, temp3;
+        courses.reserve(totalCourses);
+        string_view name, code, field, prereq;
         u32 credit, semester;
-        vector<string> prereqs;
-        while (getline(file, temp1)) {
-            if (temp1.empty()) continue;
-            istringstream iss(temp1);
-            if (!getline(iss, code, ',')) continue;
-            if (!getline(iss, name, ',')) continue;
+        while (nextLine(content, pos, line)) {
+            if (line.empty()) continue;
+            u64 linePos = 0;
+            if (!nextField(line, linePos, ',', code)) continue;
+            if (!nextField(line, linePos, ',', name)) continue;
             //学时
-            if (!getline(iss, temp2, ',')) continue;
-            try { credit = stoul(temp2); } catch (...) {
-                setError("课程 " + code + "（" + name + "）的学时无效。");
-                return false;
+            if (!nextField(line, linePos, ',', field)) continue;
+            if (!parseU32(field, credit)) {
+                return { .error = "课程 " + string(code) + "（" + string(name) + "）的学时无效。" };
             }
             if (credit == 0) {
-                setError("课程 " + code + "（" + name + "）的学时不能为零。");
-                return false;
+                return { .error = "课程 " + string(code) + "（" + string(name) + "）的学时不能为零。" };
             }
             //指定学期
-            if (!getline(iss, temp2, ',')) continue;
-            try { semester = stoul(temp2); } catch (...) {
-                setError("课程 " + code + "（" + name + "）的指定学期无效。");
-                return false;
+            if (!nextField(line, linePos, ',', field)) continue;
+            if (!parseU32(field, semester)) {
+                return { .error = "课程 " + string(code) + "（" + string(name) + "）的指定学期无效。" };
             }
+            Course& course = courses.emplace_back(name, code, vector<string_view>(), credit, semester);
             //先修课程（以分号分隔）
-            if (getline(iss, temp2)) {
-                istringstream prereqStream(temp2);
-                while (getline(prereqStream, temp3, ';')) {
-                    if (!temp3.empty()) prereqs.push_back(temp3);
+            if (linePos < line.size()) {
+                field = line.substr(linePos);
+                course.prerequisites.reserve(static_cast<u64>(std::count(field.begin(), field.end(), ';')) + 1);
+                u64 prereqPos = 0;
+                while (nextField(field, prereqPos, ';', prereq)) {
+                    if (!prereq.empty()) course.prerequisites.emplace_back(prereq);
                     else {
-                        setError("课程 " + code + "（" + name + "）的先修课程列表格式错误。");
-                        return false;
+                        return { .error = "课程 " + string(code) + "（" + string(name) + "）的先修课程列表格式错误。" };
                     }
                 }
             }
-            courses.emplace_back(name, code, move(prereqs), credit, semester);
-            prereqs.clear();
         }
-        if (courses.size() != totalCourses) {
-            setError("课程数量与第一行指定的总课程数不符。");
-            return false;
+        string error;
+        if (!checkCourseCount(semesterLimits, courses.size(), error)) return { .error = error };
+        span.stop();
+        buildCourseGraph(courses, result.value.graph);
+        return result;
+    }
+
+    [[nodiscard]] inline Result<Curriculum> loadInfoFromFile(const string& filePathStr) noexcept {
+        Stats::Span span(Stats::Phase::Parse);
+        path filePath(filePathStr);
+        if (!normalize(filePath)) {
+            return { .error = "无法规范化文件路径：" + filePathStr };
         }
-        return true;
+        MappedFile file;
+        if (!file.open(filePath)) {
+            return { .error = "无法打开文件：" + filePath.string() };
+        }
+        span.stop();
+        return parseCurriculum(file.view());
     }
 
-    [[nodiscard]] inline vector<vector<string>> sortCourses(const vector<Course>& courses, const vector<u32>& semesterLimits) noexcept {
-        vector<vector<string>> result;
-        if (courses.empty() || semesterLimits.empty()) {
-            setError("数据无效。");
-            return result;
+    //选修课程（未指定学期）进入学期安排的优先顺序，同优先级的课程按文件中的顺序安排
+    enum class SchedulePriority : u8 {
+        FileOrder,
+        MostDependents,
+        FewestCredits,
+        CriticalPath,
+    };
+
+    //精确统计后续课程数的工作量上限（约为 课程数 / 64 ×（课程数 + 先修关系数）次字操作）
+    inline constexpr u64 exactDescendantBudget = u64(1) << 27;
+
+    //关键路径优先的名次：先比较到最后一门后续课程的最长先修链长度，再比较后续课程数（能经先修关系到达的课程数），都是越大越靠前；
+    //后续课程数按拓扑序每 64 门课程一组，逆拓扑序传播可达位集后计数；工作量超过 exactDescendantBudget 时
+    //改为沿各条边累加的近似值（经多条路径到达的课程会重复计数）。处于环中的课程排在最后
+    [[nodiscard]] inline vector<u32> getCriticalPathRanks(const CourseGraph& graph) noexcept {
+        const u32 courseCount = graph.size();
+        vector<u32> inDegree(graph.inDegree), order, height(courseCount, 0), ranks(courseCount);
+        vector<u64> descendants(courseCount, 0);
+        order.reserve(courseCount);
+        for (u32 i = 0; i < courseCount; i++) if (inDegree[i] == 0) order.push_back(i);
+        for (u32 i = 0; i < order.size(); i++) for (u32 j = graph.offsets[order[i]]; j < graph.offsets[order[i] + 1]; j++) if (--inDegree[graph.dependents[j]] == 0) order.push_back(graph.dependents[j]);
+        const u32 sortedCount = static_cast<u32>(order.size());
+        const bool exact = (sortedCount / 64 + 1) * (u64(sortedCount) + graph.dependents.size()) <= exactDescendantBudget;
+        for (u32 i = sortedCount; i-- > 0;) {
+            const u32 course = order[i];
+            for (u32 j = graph.offsets[course]; j < graph.offsets[course + 1]; j++) {
+                const u32 next = graph.dependents[j];
+                height[course] = std::max(height[course], height[next] + 1);
+                if (!exact) descendants[course] = std::min<u64>(descendants[course] + descendants[next] + 1, UINT32_MAX);
+            }
         }
-        unordered_map<string, u32> courseIndex;
-        unordered_map<string, vector<u32>> adjacencyList;
-        vector<u32> inDegree(courses.size(), 0);
-        for (u32 i = 0; i < courses.size(); i++) courseIndex[courses[i].code] = i;
-        for (u32 i = 0; i < courses.size(); i++) for (u32 j = 0; j < courses[i].prerequisites.size(); j++) {
-            auto it = courseIndex.find(courses[i].prerequisites[j]);
-            if (it != courseIndex.end()) {
-                adjacencyList[courses[i].prerequisites[j]].push_back(i);
-                inDegree[i]++;
-            }
-        }
-        vector<bool> scheduled(courses.size(), false);
-        u32 totalScheduled = 0;
-        for (u64 currentSemester = 0; currentSemester < semesterLimits.size(); currentSemester++) {
-            vector<string> arrangement;
-            u32 limit = semesterLimits[currentSemester], scheduledCount = 0, totalCredits = 0;
-            vector<u32> requiredCourses, availableCourses;
-            for (u64 i = 0; i < courses.size(); i++) {
-                if (scheduled[i] || inDegree[i] > 0) continue;
-                if (courses[i].semester == currentSemester + 1) requiredCourses.push_back(i);
-                else if (courses[i].semester == 0) availableCourses.push_back(i);
+        if (exact) {
+            //reach[i] 为拓扑序第 i 门课程能到达的、本组中的课程；后续课程都在拓扑序中更靠后，只需处理本组末尾之前的课程
+            vector<u32> position(courseCount, UINT32_MAX);
+            for (u32 i = 0; i < sortedCount; i++) position[order[i]] = i;
+            vector<u64> reach(sortedCount);
+            for (u32 first = 0; first < sortedCount; first += 64) {
+                const u32 last = std::min(first + 64, sortedCount);
+                for (u32 i = last; i-- > 0;) {
+                    u64 mask = 0;
+                    for (u32 j = graph.offsets[order[i]]; j < graph.offsets[order[i] + 1]; j++) {
+                        const u32 next = position[graph.dependents[j]];
+                        if (next >= last) continue;
+                        mask |= reach[next];
+                        if (next >= first) mask |= u64(1) << (next - first);
+                    }
+                    reach[i] = mask;
+                    descendants[order[i]] += std::popcount(mask);
+                }
+            }
+        }
+        //不在拓扑序中的课程（处于环中或依赖于环）排在最后
+        for (u32 i = 0; i < courseCount; i++) if (inDegree[i] != 0) order.push_back(i);
+        std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) noexcept {
+            if ((inDegree[a] == 0) != (inDegree[b] == 0)) return inDegree[a] == 0;
+            if (height[a] != height[b]) return height[a] > height[b];
+            if (descendants[a] != descendants[b]) return descendants[a] > descendants[b];
+            return a < b;
+        });
+        for (u32 i = 0; i < courseCount; i++) ranks[order[i]] = i;
+        return ranks;
+    }
+
+    //优先级越高键值越小，低 32 位为课程编号，保证键值唯一且同优先级时按文件顺序；criticalRanks 仅在按关键路径排序时使用
+    [[nodiscard]] inline u64 getPriorityKey(const vector<Course>& courses, const CourseGraph& graph, SchedulePriority priority, u32 course, const vector<u32>& criticalRanks) noexcept {
+        u64 key = 0;
+        switch (priority) {
+            case SchedulePriority::FileOrder: break;
+            case SchedulePriority::MostDependents: key = UINT32_MAX - (graph.offsets[course + 1] - graph.offsets[course]); break;
+            case SchedulePriority::FewestCredits: key = courses[course].credit; break;
+            case SchedulePriority::CriticalPath: key = criticalRanks[course]; break;
+        }
+        return key << 32 | course;
+    }
+
+    //逐学期的安排结果：semesters[i] 为第 i + 1 学期的课程（可能为空），semesterOf 为每门课程所在的学期下标，未安排时为 UINT32_MAX
+    struct SemesterPlan {
+        vector<vector<u32>> semesters;
+        vector<u32> semesterOf;
+    };
+
+    //从第 firstSemester + 1 学期起重新安排，之前各学期沿用 plan 中的结果（必须由相同的数据得到）；
+    //失败时将原因写入 error，此时 plan.semesters 只包含出错学期之前的学期
+    [[nodiscard]] inline bool planSemesters(const vector<Course>& courses, const CourseGraph& graph, const vector<u32>& semesterLimits, SchedulePriority priority, u64 firstSemester, SemesterPlan& plan, string& error) noexcept {
+        if (courses.empty() || semesterLimits.empty() || graph.size() != courses.size() || firstSemester > plan.semesters.size()) {
+            error = "数据无效。";
+            return false;
+        }
+        const Stats::Span span(Stats::Phase::Assign);
+        //只在本次安排中使用的数据都分配在线程的暂存区中，返回时一并释放
+        const ScratchArena::Scope scratch;
+        const u64 semesterCount = semesterLimits.size();
+        const vector<u32> criticalRanks = priority == SchedulePriority::CriticalPath ? getCriticalPathRanks(graph) : vector<u32>();
+        plan.semesters.resize(firstSemester);
+        plan.semesterOf.resize(courses.size(), UINT32_MAX);
+        std::pmr::vector<u32> inDegree(graph.inDegree.begin(), graph.inDegree.end(), scratch.resource());
+        std::pmr::vector<bool> scheduled(courses.size(), false, scratch.resource());
+        for (u32 i = 0; i < courses.size(); i++) {
+            if (plan.semesterOf[i] >= firstSemester) plan.semesterOf[i] = UINT32_MAX;
+            else {
+                scheduled[i] = true;
+                for (u32 j = graph.offsets[i]; j < graph.offsets[i + 1]; j++) inDegree[graph.dependents[j]]--;
+            }
+        }
+        //指定学期的课程在先修课程全部安排后放入对应学期的桶中，错过指定学期的课程不再进入任何桶
+        std::pmr::vector<std::pmr::vector<u32>> requiredBuckets(semesterCount, scratch.resource());
+        //可选课程按学时分组的小根堆，学时超过 50 的课程永远无法安排，不进入堆
+        std::pmr::vector<std::priority_queue<u64, std::pmr::vector<u64>, std::greater<u64>>> availableQueues(51, scratch.resource());
+        std::pmr::vector<u32> newlyAvailable(scratch.resource());
+        const auto makeReady = [&](u32 course, u64 currentSemester, bool initial) noexcept {
+            const Course& info = courses[course];
+            if (info.semester != 0) {
+                if (info.semester <= semesterCount && (initial ? info.semester > currentSemester : info.semester > currentSemester + 1)) requiredBuckets[info.semester - 1].push_back(course);
+            }
+            else if (info.credit <= 50) {
+                if (initial) availableQueues[info.credit].push(getPriorityKey(courses, graph, priority, course, criticalRanks));
+                else newlyAvailable.push_back(course);
             }
+        };
+        const auto schedule = [&](u32 course, u64 currentSemester) noexcept {
+            scheduled[course] = true;
+            plan.semesterOf[course] = static_cast<u32>(currentSemester);
+            for (u32 i = graph.offsets[course]; i < graph.offsets[course + 1]; i++) if (--inDegree[graph.dependents[i]] == 0) makeReady(graph.dependents[i], currentSemester, false);
+        };
+        for (u32 i = 0; i < courses.size(); i++) if (!scheduled[i] && inDegree[i] == 0) makeReady(i, firstSemester, true);
+        for (u64 currentSemester = firstSemester; currentSemester < semesterCount; currentSemester++) {
+            vector<u32> arrangement;
+            u32 limit = semesterLimits[currentSemester], scheduledCount = 0, totalCredits = 0;
+            arrangement.reserve(std::min<u32>(limit, 50));
+            std::pmr::vector<u32>& requiredCourses = requiredBuckets[currentSemester];
+            std::sort(requiredCourses.begin(), requiredCourses.end());
             if (requiredCourses.size() > limit) {
-                setError("第 " + to_string(currentSemester + 1) + " 学期的必修课程数量（" + to_string(requiredCourses.size()) + "）超过了学期限制（" + to_string(limit) + "）。");
-                result.clear();
-                return result;
+                error = "第 " + to_string(currentSemester + 1) + " 学期的必修课程数量（" + to_string(requiredCourses.size()) + "）超过了学期限制（" + to_string(limit) + "）。";
+                return false;
             }
             u32 requiredCredits = 0;
             for (u32 i = 0; i < requiredCourses.size(); i++) requiredCredits += courses[requiredCourses[i]].credit;
             if (requiredCredits > 50) {
-                setError("第 " + to_string(currentSemester + 1) + " 学期的必修课程学分（" + to_string(requiredCredits) + "）超过了50学分的限制。");
-                result.clear();
-                return result;
+                error = "第 " + to_string(currentSemester + 1) + " 学期的必修课程学分（" + to_string(requiredCredits) + "）超过了50学分的限制。";
+                return false;
             }
             for (u32 i = 0; i < requiredCourses.size(); i++) {
-                arrangement.push_back(courses[requiredCourses[i]].code);
-                scheduled[requiredCourses[i]] = true;
+                arrangement.push_back(requiredCourses[i]);
                 scheduledCount++;
-                totalScheduled++;
                 totalCredits += courses[requiredCourses[i]].credit;
-                for (const u32 dependent : adjacencyList[courses[requiredCourses[i]].code]) inDegree[dependent]--;
+                schedule(requiredCourses[i], currentSemester);
             }
-            for (u32 i = 0; i < availableCourses.size(); i++) {
-                if (scheduledCount >= limit || scheduledCount >= 50) break;
-                if (totalCredits + courses[availableCourses[i]].credit > 50) continue;
-                arrangement.push_back(courses[availableCourses[i]].code);
-                scheduled[availableCourses[i]] = true;
+            //每次取出剩余学分能容纳的课程中优先级最高的一门，与按优先顺序扫描并跳过放不下的课程等价
+            while (scheduledCount < limit && scheduledCount < 50 && totalCredits < 50) {
+                u32 bestCredit = 0;
+                for (u32 credit = 1; credit <= 50 - totalCredits; credit++) if (!availableQueues[credit].empty() && (bestCredit == 0 || availableQueues[credit].top() < availableQueues[bestCredit].top())) bestCredit = credit;
+                if (bestCredit == 0) break;
+                const u32 course = static_cast<u32>(availableQueues[bestCredit].top());
+                availableQueues[bestCredit].pop();
+                arrangement.push_back(course);
                 scheduledCount++;
-                totalScheduled++;
-                totalCredits += courses[availableCourses[i]].credit;
-                for (const u32 dependent : adjacencyList[courses[availableCourses[i]].code]) inDegree[dependent]--;
+                totalCredits += bestCredit;
+                schedule(course, currentSemester);
             }
-            if (scheduledCount > 0) result.push_back(arrangement);
+            for (const u32 course : newlyAvailable) availableQueues[courses[course].credit].push(getPriorityKey(courses, graph, priority, course, criticalRanks));
+            newlyAvailable.clear();
+            plan.semesters.push_back(move(arrangement));
         }
         for (u64 i = 0; i < courses.size(); i++) if (!scheduled[i]) {
-            if (courses[i].semester != 0) setError("课程 " + courses[i].code + "（" + courses[i].name + "）要求在第 " + to_string(courses[i].semester) + " 学期修读，但由于先修课程的限制无法满足。");
-            else setError("课程 " + courses[i].code + "（" + courses[i].name + "）由于学期限制或先修课程的限制无法安排。");
-            result.clear();
-            return result;
+            if (courses[i].semester != 0) error = "课程 " + string(courses[i].code) + "（" + string(courses[i].name) + "）要求在第 " + to_string(courses[i].semester) + " 学期修读，但由于先修课程的限制无法满足。";
+            else error = "课程 " + string(courses[i].code) + "（" + string(courses[i].name) + "）由于学期限制或先修课程的限制无法安排。";
+            return false;
+        }
+        return true;
+    }
+
+    //学期安排的必要条件，都只需线性时间：先修链是否超出总学期数、指定学期是否早于先修链允许的学期、
+    //各学期指定的课程是否超出上限，以及只能在第 k 学期及以后修读的课程数与学时是否超过这些学期的上限之和。
+    //不满足时 planSemesters 一定失败，此时将具体原因写入 error 并返回 false；满足时仍可能无法安排。先修关系有环时环中的课程可能不参与检查
+    [[nodiscard]] inline bool checkSemesterBounds(const vector<Course>& courses, const CourseGraph& graph, const vector<u32>& semesterLimits, string& error) noexcept {
+        const u32 courseCount = graph.size();
+        const u32 semesterCount = static_cast<u32>(semesterLimits.size());
+        if (courses.size() != courseCount || semesterCount == 0) return true;
+        const Stats::Span span(Stats::Phase::Analyze);
+        const ScratchArena::Scope scratch;
+        //ordered 时按课程编号的顺序处理（培养方案通常按先修顺序列出课程，这时编号本身就是拓扑序），否则按 order 中的拓扑序
+        bool ordered = true;
+        std::pmr::vector<u32> order(scratch.resource());
+        const auto at = [&](u32 i) noexcept { return ordered ? i : order[i]; };
+        //earliest 为考虑指定学期后最早可以修读的学期（从 1 开始）；处理到一门课程之前，其中是已处理的先修课程传来的下界
+        std::pmr::vector<u32> earliest(courseCount, 0, scratch.resource()), links(scratch.resource());
+        //出错时才求出决定 earliest 的先修课程：只看处理顺序中前 last 门课程，指定学期的课程（出错的 target 除外）是链的起点
+        const auto link = [&](u32 last, u32 target) noexcept {
+            links.assign(courseCount, UINT32_MAX);
+            for (u32 i = 0; i < last; i++) {
+                const u32 course = at(i);
+                for (u32 j = graph.offsets[course]; j < graph.offsets[course + 1]; j++) {
+                    const u32 dependent = graph.dependents[j];
+                    if ((courses[dependent].semester == 0 || dependent == target) && earliest[dependent] == earliest[course] + 1) links[dependent] = course;
+                }
+            }
+        };
+        //沿 links 从 course 往回走到链的起点，给出链的首尾与课程数
+        const auto chain = [&](u32 course) noexcept {
+            u32 first = course, length = 1;
+            for (; links[first] != UINT32_MAX; length++) first = links[first];
+            const string pin = courses[first].semester != 0 ? "，" + string(courses[first].code) + " 指定在第 " + to_string(courses[first].semester) + " 学期" : "";
+            return length == 1 ? string(courses[course].code) : string(courses[first].code) + (length > 2 ? " → … → " : " → ") + string(courses[course].code) + "（共 " + to_string(length) + " 门课程" + pin + "）";
+        };
+        const auto label = [&](u32 course) noexcept { return "课程 " + string(courses[course].code) + "（" + string(courses[course].name) + "）"; };
+        //各学期的课程数与学时上限与 planSemesters 一致
+        std::pmr::vector<u64> pinnedCount(semesterCount + 1, 0, scratch.resource()), pinnedCredits(semesterCount + 1, 0, scratch.resource());
+        std::pmr::vector<u64> earliestCount(semesterCount + 1, 0, scratch.resource()), earliestCredits(semesterCount + 1, 0, scratch.resource());
+        //依次处理前 sortedCount 门课程并向后传递 earliest；ordered 时遇到指向前面课程的先修关系就清除 ordered 并停下。
+        //停下之前得到的仍是真实的下界，其间报告的错误同样成立
+        const auto propagate = [&](u32 sortedCount) noexcept {
+            for (u32 i = 0; i < sortedCount; i++) {
+                const u32 course = at(i);
+                const Course& info = courses[course];
+                if (info.credit > 50) {
+                    error = label(course) + "的学时（" + to_string(info.credit) + "）超过了每学期50学分的限制。";
+                    return false;
+                }
+                if (info.semester > semesterCount) {
+                    error = label(course) + "指定的第 " + to_string(info.semester) + " 学期超过了总学期数（" + to_string(semesterCount) + "）。";
+                    return false;
+                }
+                if (info.semester != 0 && earliest[course] > info.semester) {
+                    link(i, course);
+                    error = label(course) + "要求在第 " + to_string(info.semester) + " 学期修读，但受先修链 " + chain(course) + " 的限制，最早只能在第 " + to_string(earliest[course]) + " 学期修读。";
+                    return false;
+                }
+                if (earliest[course] > semesterCount) {
+                    link(i, course);
+                    error = "先修链 " + chain(course) + " 超过了总学期数（" + to_string(semesterCount) + "）。";
+                    return false;
+                }
+                earliest[course] = info.semester != 0 ? info.semester : std::max(earliest[course], 1u);
+                pinnedCount[info.semester]++;
+                pinnedCredits[info.semester] += info.credit;
+                earliestCount[earliest[course]]++;
+                earliestCredits[earliest[course]] += info.credit;
+                for (u32 j = graph.offsets[course]; j < graph.offsets[course + 1]; j++) {
+                    const u32 dependent = graph.dependents[j];
+                    if (ordered && dependent <= course) {
+                        ordered = false;
+                        return true;
+                    }
+                    earliest[dependent] = std::max(earliest[dependent], earliest[course] + 1);
+                }
+            }
+            return true;
+        };
+        if (!propagate(courseCount)) return false;
+        //编号不是拓扑序时用 Kahn 算法求出拓扑序从头计算，环中的课程不在其中，不参与检查
+        if (!ordered) {
+            std::pmr::vector<u32> inDegree(graph.inDegree.begin(), graph.inDegree.end(), scratch.resource());
+            order.reserve(courseCount);
+            for (u32 i = 0; i < courseCount; i++) if (inDegree[i] == 0) order.push_back(i);
+            for (u32 i = 0; i < order.size(); i++) for (u32 j = graph.offsets[order[i]]; j < graph.offsets[order[i] + 1]; j++) if (--inDegree[graph.dependents[j]] == 0) order.push_back(graph.dependents[j]);
+            earliest.assign(courseCount, 0);
+            for (std::pmr::vector<u64>* counts : { &pinnedCount, &pinnedCredits, &earliestCount, &earliestCredits }) counts->assign(semesterCount + 1, 0);
+            if (!propagate(static_cast<u32>(order.size()))) return false;
         }
+        for (u32 k = 1; k <= semesterCount; k++) {
+            if (pinnedCount[k] > semesterLimits[k - 1]) {
+                error = "第 " + to_string(k) + " 学期的必修课程数量（" + to_string(pinnedCount[k]) + "）超过了学期限制（" + to_string(semesterLimits[k - 1]) + "）。";
+                return false;
+            }
+            if (pinnedCredits[k] > 50) {
+                error = "第 " + to_string(k) + " 学期的必修课程学分（" + to_string(pinnedCredits[k]) + "）超过了50学分的限制。";
+                return false;
+            }
+        }
+        //从最后一个学期往前累加，k 为 1 时比较的是全部课程与所有学期的上限之和
+        u64 count = 0, credits = 0, capacity = 0;
+        for (u32 k = semesterCount; k >= 1; k--) {
+            count += earliestCount[k];
+            credits += earliestCredits[k];
+            capacity += std::min<u32>(semesterLimits[k - 1], 50);
+            if (count > capacity) {
+                error = (k == 1 ? "共有 " + to_string(count) + " 门课程，超过了所有学期" : "至少有 " + to_string(count) + " 门课程只能在第 " + to_string(k) + " 学期及以后修读，超过了这些学期") + "的课程数上限之和（" + to_string(capacity) + "）。";
+                return false;
+            }
+            if (credits > 50ull * (semesterCount - k + 1)) {
+                error = (k == 1 ? "全部课程共 " + to_string(credits) + " 学分，超过了所有学期" : "第 " + to_string(k) + " 学期及以后至少需要修读 " + to_string(credits) + " 学分的课程，超过了这些学期") + "的学分上限之和（" + to_string(50ull * (semesterCount - k + 1)) + "）。";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //先做线性时间的必要条件检查，明显无法安排的输入不进入逐学期的安排
+    [[nodiscard]] inline Result<vector<vector<u32>>> sortCourses(const vector<Course>& courses, const CourseGraph& graph, const vector<u32>& semesterLimits, SchedulePriority priority = SchedulePriority::FileOrder) noexcept {
+        Result<vector<vector<u32>>> result;
+        SemesterPlan plan;
+        if (!checkSemesterBounds(courses, graph, semesterLimits, result.error)) return result;
+        if (!planSemesters(courses, graph, semesterLimits, priority, 0, plan, result.error)) return result;
+        //没有课程的学期不出现在结果中
+        for (vector<u32>& arrangement : plan.semesters) if (!arrangement.empty()) result.value.push_back(move(arrangement));
         return result;
     }
 
-    struct Schedule {
-        array<array<string, 10>, 5> slots;
+    //按天 × 节次划分的周课表，时段总数不超过 64，以便用一个 u64 记录占用情况；
+    //每个时段保存课程在该学期安排中的下标，课程名称只在输出时解析
+    template<u32 Days, u32 Slots> struct BasicSchedule {
+        static_assert(Days > 0 && Slots > 0 && Days * Slots <= 64, "课表的时段总数必须在 1 到 64 之间。");
+        static constexpr u32 days = Days, slotsPerDay = Slots;
+        //空闲时段的标记，一个学期最多可以安排 emptySlot 门课程
+        static constexpr u8 emptySlot = UINT8_MAX;
+        array<array<u8, Slots>, Days> slots;
 
-        [[nodiscard]] explicit Schedule() noexcept = default;
+        [[nodiscard]] explicit BasicSchedule() noexcept { for (array<u8, Slots>& day : slots) day.fill(emptySlot); }
     };
 
+    typedef BasicSchedule<5, 10> Schedule;
+
     struct CourseSlot {
-        string code, name;
-        u32 credits, sessionsPerWeek;
-        vector<u32> sessionLengths;
+        u32 course, credits, sessionsPerWeek;
+        array<u32, 3> sessionLengths;
     };
 
-    [[nodiscard]] inline bool canPlace(const vector<bool>& slotUsed, u32 day, u32 startSlot, u32 length) noexcept {
-        if (startSlot + length > 10) return false;
-        for (u32 i = 0; i < length; i++) if (slotUsed[day * 10 + startSlot + i]) return false;
-        return true;
+    //3 学时以内一次上完，6 学时以内分两次，更多则分三次
+    [[nodiscard]] inline CourseSlot getCourseSlot(const vector<Course>& courses, u32 course) noexcept {
+        const u32 credit = courses[course].credit;
+        if (credit <= 3) return { course, credit, 1, { credit, 0, 0 } };
+        if (credit <= 6) return { course, credit, 2, { credit / 2, credit - credit / 2, 0 } };
+        return { course, credit, 3, { credit / 3, credit / 3, credit - 2 * (credit / 3) } };
     }
 
-    inline void place(Schedule& schedule, vector<bool>& slotUsed, u32 day, u32 startSlot, u32 length, const string& name) noexcept {
-        for (u32 i = 0; i < length; i++) {
-            schedule.slots[day][startSlot + i] = name;
-            slotUsed[day * 10 + startSlot + i] = true;
+    //每种课时长度的候选起始节次，primary 为首选位置，fallback 仅在此前没有任何候选位置时才考虑
+    template<u32 Slots> struct PlacementTable {
+        array<u8, Slots> primary{}, fallback{};
+        u8 primaryCount = 0, fallbackCount = 0;
+    };
+
+    //以上下午各半天为单位：1 节课放在半天的后三节，2 节课放在半天开头，3 节课放在半天的第 3 节起
+    template<u32 Slots> [[nodiscard]] consteval array<PlacementTable<Slots>, Slots + 1> makePlacementTables() noexcept {
+        array<PlacementTable<Slots>, Slots + 1> tables{};
+        constexpr u32 half = Slots / 2;
+        const auto add = [](array<u8, Slots>& list, u8& count, u32 startSlot, u32 length) {
+            if (length <= Slots && startSlot <= Slots - length) list[count++] = static_cast<u8>(startSlot);
+        };
+        for (const u32 halfStart : { 0u, half }) for (u32 s = halfStart + 2; s < halfStart + half; s++) add(tables[1].primary, tables[1].primaryCount, s, 1);
+        if constexpr (Slots >= 2) {
+            add(tables[2].primary, tables[2].primaryCount, 0, 2);
+            add(tables[2].primary, tables[2].primaryCount, half, 2);
+            add(tables[2].fallback, tables[2].fallbackCount, half - 2, 2);
+            add(tables[2].fallback, tables[2].fallbackCount, half + 2, 2);
+        }
+        if constexpr (Slots >= 3) {
+            add(tables[3].primary, tables[3].primaryCount, 2, 3);
+            add(tables[3].primary, tables[3].primaryCount, half + 2, 3);
+            add(tables[3].fallback, tables[3].fallbackCount, 0, 3);
+            add(tables[3].fallback, tables[3].fallbackCount, half, 3);
         }
+        return tables;
     }
 
-    [[nodiscard]] inline vector<Schedule> getSchedules(const vector<Course>& courses, const vector<vector<string>>& arrangements) noexcept {
-        vector<Schedule> schedules;
-        if (courses.empty() || arrangements.empty()) {
-            setError("数据无效。");
-            return schedules;
+    template<u32 Slots> inline constexpr array<PlacementTable<Slots>, Slots + 1> placementTables = makePlacementTables<Slots>();
+
+    //尽量避开每天第一节和下午第三节开始的时段
+    template<u32 Slots> [[nodiscard]] constexpr bool isPreferredStart(u32 startSlot) noexcept { return startSlot != 0 && startSlot != Slots / 2 + 2; }
+
+    template<u32 Slots> [[nodiscard]] constexpr u64 getSlotMask(u32 day, u32 startSlot, u32 length) noexcept { return (length >= 64 ? ~0ull : (1ull << length) - 1) << (day * Slots + startSlot); }
+
+    template<u32 Slots> [[nodiscard]] constexpr bool canPlace(u64 slotUsed, u32 day, u32 startSlot, u32 length) noexcept { return length <= Slots && startSlot <= Slots - length && (slotUsed & getSlotMask<Slots>(day, startSlot, length)) == 0; }
+
+    template<u32 Days, u32 Slots> inline void place(BasicSchedule<Days, Slots>& schedule, u64& slotUsed, u32 day, u32 startSlot, u32 length, u8 index) noexcept {
+        for (u32 i = 0; i < length; i++) schedule.slots[day][startSlot + i] = index;
+        slotUsed |= getSlotMask<Slots>(day, startSlot, length);
+    }
+
+    //同一课程的各次课安排在互不相邻的日子，blockedDays 为已被排除的日子；找不到候选位置时退回到整张课表中的第一个空位
+    template<u32 Days, u32 Slots> [[nodiscard]] inline bool findPlacement(u64 slotUsed, u32 blockedDays, u32 length, u32& day, u32& startSlot) noexcept {
+        if (length == 0 || length > Slots) return false;
+        Stats::Tally candidates(Stats::Counter::Candidates);
+        bool found = false;
+        if (length < placementTables<Slots>.size()) {
+            const PlacementTable<Slots>& table = placementTables<Slots>[length];
+            //候选位置按天、按表中顺序排列，取第一个首选起始节次，没有则取第一个候选位置
+            const auto tryStart = [&](u32 d, u32 s) noexcept {
+                candidates.value++;
+                if (!canPlace<Slots>(slotUsed, d, s, length) || (found && !isPreferredStart<Slots>(s))) return false;
+                found = true;
+                day = d;
+                startSlot = s;
+                return isPreferredStart<Slots>(s);
+            };
+            for (u32 d = 0; d < Days; d++) {
+                if (blockedDays >> d & 1) continue;
+                for (u32 i = 0; i < table.primaryCount; i++) if (tryStart(d, table.primary[i])) return true;
+                if (!found) for (u32 i = 0; i < table.fallbackCount; i++) if (tryStart(d, table.fallback[i])) return true;
+            }
         }
-        unordered_map<string, Course> courseMap;
-        for (u64 i = 0; i < courses.size(); i++) courseMap[courses[i].code] = courses[i];
-        for (u64 semesterIdx = 0; semesterIdx < arrangements.size(); semesterIdx++) {
-            Schedule schedule;
-            vector<CourseSlot> courseSlots;
-            vector<bool> slotUsed(50, false);
-            for (u64 i = 0; i < arrangements[semesterIdx].size(); i++) {
-                const auto it = courseMap.find(arrangements[semesterIdx][i]);
-                if (it == courseMap.end()) {
-                    setError("无法找到课程代码 " + arrangements[semesterIdx][i] + " 对应的课程信息。");
-                    schedules.clear();
-                    return schedules;
-                }
-                const Course& course = it->second;
-                CourseSlot slot = {
-                    .code = course.code,
-                    .name = course.name,
-                    .credits = course.credit,
-                };
-                if (course.credit <= 3) {
-                    slot.sessionsPerWeek = 1;
-                    slot.sessionLengths.push_back(course.credit);
-                }
-                else if (course.credit <= 6) {
-                    u32 half = course.credit / 2;
-                    slot.sessionsPerWeek = 2;
-                    slot.sessionLengths.push_back(half);
-                    slot.sessionLengths.push_back(course.credit - half);
+        if (found) return true;
+        Stats::add(Stats::Counter::FallbackScans, 1);
+        for (u32 d = 0; d < Days; d++) for (u32 s = 0; s <= Slots - length; s++) {
+            candidates.value++;
+            if (!canPlace<Slots>(slotUsed, d, s, length)) continue;
+            day = d;
+            startSlot = s;
+            return true;
+        }
+        Stats::add(Stats::Counter::FailedPlacements, 1);
+        return false;
+    }
+
+    [[nodiscard]] inline u32 getBlockedDays(u32 blockedDays, u32 day) noexcept { return blockedDays | (7u << day) >> 1; }
+
+    struct PlacementOptions {
+        //贪心放置失败时改用精确搜索
+        bool exact = false;
+        //精确搜索时同一课程的各次课是否必须安排在互不相邻的日子，否则仅作为软约束计入代价
+        bool strictDaySpread = true;
+        //找到可行方案后继续搜索代价更低的方案，直到搜索完毕或达到上限
+        bool optimize = false;
+        //搜索节点数与时间上限（毫秒），为 0 表示不限制
+        u64 nodeLimit = 2000000;
+        u32 timeLimit = 1000;
+    };
+
+    //各长度的课在各起始节次上的代价：首选表中的首选起始节次为 0，其余候选位置为 1 或 2，表外位置为 3
+    template<u32 Slots> [[nodiscard]] consteval array<array<u8, Slots>, Slots + 1> makeStartPenalties() noexcept {
+        array<array<u8, Slots>, Slots + 1> penalties{};
+        for (u32 length = 1; length <= Slots; length++) {
+            for (u32 s = 0; s < Slots; s++) penalties[length][s] = 3;
+            const PlacementTable<Slots>& table = placementTables<Slots>[length];
+            for (u32 i = 0; i < table.fallbackCount; i++) penalties[length][table.fallback[i]] = isPreferredStart<Slots>(table.fallback[i]) ? 1 : 2;
+            for (u32 i = 0; i < table.primaryCount; i++) penalties[length][table.primary[i]] = isPreferredStart<Slots>(table.primary[i]) ? 0 : 1;
+        }
+        return penalties;
+    }
+
+    template<u32 Slots> inline constexpr array<array<u8, Slots>, Slots + 1> startPenalties = makeStartPenalties<Slots>();
+
+    //精确放置：同一天内的若干次课总能首尾相接地排下，因此先分支定界搜索每次课安排在哪一天（按天装箱），
+    //再对每一天用状态压缩动态规划确定代价最小的起始节次。每次优先处理可选日子最少的课程，并以软约束代价为界剪枝
+    template<u32 Days, u32 Slots> class ExactPlacer {
+        static_assert(Slots <= 16, "精确放置要求每天的节次数不超过 16。");
+        static constexpr u32 allDays = (1u << Days) - 1, spreadPenalty = 8;
+        const vector<CourseSlot>& courseSlots;
+        const PlacementOptions& options;
+        //twins[i] 为前一门课时结构完全相同的课程，两者可以互换，因此只枚举首次课所在日子不减的安排
+        vector<u32> nextSession, blockedDays, twins;
+        vector<array<u32, 3>> sessionDays, bestDays;
+        //arrangeDay 与 collectDaySessions 的缓冲区，搜索的每个叶子都会用到，因此在多次调用之间复用
+        vector<u16> dayCost, dayChoice;
+        vector<pair<u32, u32>> daySessions;
+        array<u32, Days> freeSlots;
+        u64 nodes = 0;
+        u32 remainingSessions = 0, bestPenalty = UINT32_MAX;
+        bool stopped = false;
+        std::chrono::steady_clock::time_point deadline;
+
+        //在 days 中选出 k 个互不相邻的日子时，最少有几天落在 set 中；不存在任何选法时为 UINT8_MAX
+        [[nodiscard]] static consteval array<array<array<u8, 1u << Days>, 1u << Days>, 4> makeMinimumInside() noexcept {
+            array<array<array<u8, 1u << Days>, 1u << Days>, 4> minimum{};
+            for (u32 k = 1; k <= 3; k++) for (u32 days = 0; days < 1u << Days; days++) for (u32 set = 0; set < 1u << Days; set++) {
+                u32 best = UINT8_MAX;
+                for (u32 subset = days; subset != 0; subset = (subset - 1) & days) if (static_cast<u32>(std::popcount(subset)) == k && (subset & subset >> 1) == 0) best = std::min(best, static_cast<u32>(std::popcount(subset & set)));
+                minimum[k][days][set] = static_cast<u8>(best);
+            }
+            return minimum;
+        }
+
+        //下一次课可以安排的日子，同一课程中长度相同的相邻两次课、以及与 twins 的首次课只按日子不减的顺序枚举，以消除对称
+        [[nodiscard]] u32 getDayOptions(u32 i) const noexcept {
+            const u32 session = nextSession[i], length = courseSlots[i].sessionLengths[session];
+            u32 days = 0;
+            for (u32 d = 0; d < Days; d++) if (freeSlots[d] >= length) days |= 1u << d;
+            if (options.strictDaySpread) days &= ~blockedDays[i];
+            if (session > 0 && courseSlots[i].sessionLengths[session - 1] == length) days &= ~0u << sessionDays[i][session - 1];
+            if (session == 0 && twins[i] != UINT32_MAX) days &= ~0u << sessionDays[twins[i]][0];
+            return days & allDays;
+        }
+
+        //严格分散时，每门课剩余的课只能落在未被排除且还有足够空位的日子上：对每个日子集合，
+        //必然落在其中的课时（剩余的课全部落在其中时计全部课时，否则每次计最短的一次）不能超过其中的空闲节数
+        [[nodiscard]] bool checkDayCapacity() const noexcept {
+            if constexpr (Days <= 6) {
+                static constexpr array<array<array<u8, 1u << Days>, 1u << Days>, 4> minimumInside = makeMinimumInside();
+                array<u32, 1u << Days> demand{}, capacity{};
+                for (u32 set = 1; set <= allDays; set++) capacity[set] = capacity[set & (set - 1)] + freeSlots[std::countr_zero(set)];
+                for (u32 i = 0; i < courseSlots.size(); i++) {
+                    const u32 remaining = courseSlots[i].sessionsPerWeek - nextSession[i];
+                    if (remaining == 0) continue;
+                    u32 shortest = Slots, total = 0, roomDays = 0;
+                    for (u32 session = nextSession[i]; session < courseSlots[i].sessionsPerWeek; session++) {
+                        shortest = std::min(shortest, courseSlots[i].sessionLengths[session]);
+                        total += courseSlots[i].sessionLengths[session];
+                    }
+                    for (u32 d = 0; d < Days; d++) if (freeSlots[d] >= shortest) roomDays |= 1u << d;
+                    const array<u8, 1u << Days>& inside = minimumInside[remaining][~blockedDays[i] & roomDays & allDays];
+                    if (inside[allDays] == UINT8_MAX) return false;
+                    for (u32 set = 1; set <= allDays; set++) demand[set] += inside[set] == remaining ? total : inside[set] * shortest;
                 }
-                else {
-                    u32 third = course.credit / 3;
-                    slot.sessionsPerWeek = 3;
-                    slot.sessionLengths.push_back(third);
-                    slot.sessionLengths.push_back(third);
-                    slot.sessionLengths.push_back(course.credit - 2 * third);
+                for (u32 set = 1; set <= allDays; set++) if (demand[set] > capacity[set]) return false;
+            }
+            return true;
+        }
+
+        //为某一天的各次课选择互不重叠、代价最小的起始节次，starts 按 sessions 的顺序给出结果
+        [[nodiscard]] u32 arrangeDay(const vector<pair<u32, u32>>& sessions, vector<u32>* starts) noexcept {
+            const u32 count = static_cast<u32>(sessions.size()), full = (1u << count) - 1;
+            vector<u16>& cost = dayCost;
+            vector<u16>& choice = dayChoice;
+            cost.assign((Slots + 1) << count, UINT16_MAX);
+            choice.assign((Slots + 1) << count, 0);
+            cost[0] = 0;
+            for (u32 p = 0; p < Slots; p++) for (u32 placed = 0; placed <= full; placed++) {
+                const u16 current = cost[p << count | placed];
+                if (current == UINT16_MAX) continue;
+                if (current < cost[(p + 1) << count | placed]) {
+                    cost[(p + 1) << count | placed] = current;
+                    choice[(p + 1) << count | placed] = UINT16_MAX;
                 }
-                courseSlots.emplace_back(move(slot));
-            }
-            for (u64 i = 0; i < courseSlots.size(); i++) {
-                vector<u32> usedDays;
-                for (u32 session = 0; session < courseSlots[i].sessionsPerWeek; session++) {
-                    u32 length = courseSlots[i].sessionLengths[session], day = 5, startSlot = 0;
-                    vector<pair<u32, u32>> candidates;
-                    for (u32 _day = 0; _day < 5; _day++) {
-                        bool dayUsed = false;
-                        for (u32 j = 0; j < usedDays.size(); j++) if (usedDays[j] == _day || (usedDays[j] > 0 && usedDays[j] - 1 == _day) || (usedDays[j] < 4 && usedDays[j] + 1 == _day)) {
-                            dayUsed = true;
-                            break;
-                        }
-                        if (dayUsed && usedDays.size() > 0) continue;
-                        if (length == 2 && canPlace(slotUsed, _day, 0, 2)) candidates.push_back({_day, 0});
-                        if (length == 3 && canPlace(slotUsed, _day, 2, 3)) candidates.push_back({_day, 2});
-                        if (length == 2 && canPlace(slotUsed, _day, 5, 2)) candidates.push_back({_day, 5});
-                        if (length == 3 && canPlace(slotUsed, _day, 7, 3)) candidates.push_back({_day, 7});
-                        if (length == 1) {
-                            if (canPlace(slotUsed, _day, 2, 1)) candidates.push_back({_day, 2});
-                            if (canPlace(slotUsed, _day, 3, 1)) candidates.push_back({_day, 3});
-                            if (canPlace(slotUsed, _day, 4, 1)) candidates.push_back({_day, 4});
-                            if (canPlace(slotUsed, _day, 7, 1)) candidates.push_back({_day, 7});
-                            if (canPlace(slotUsed, _day, 8, 1)) candidates.push_back({_day, 8});
-                            if (canPlace(slotUsed, _day, 9, 1)) candidates.push_back({_day, 9});
-                        }
-                        if (candidates.empty()) {
-                            if (length == 2 && canPlace(slotUsed, _day, 3, 2)) candidates.push_back({_day, 3});
-                            if (length == 2 && canPlace(slotUsed, _day, 7, 2)) candidates.push_back({_day, 7});
-                            if (length == 3 && canPlace(slotUsed, _day, 0, 3)) candidates.push_back({_day, 0});
-                            if (length == 3 && canPlace(slotUsed, _day, 5, 3)) candidates.push_back({_day, 5});
-                        }
-                    }
-                    if (candidates.empty()) {
-                        for (u32 j = 0; j < 5; j++) for (u32 s = 0; s <= 10 - length; s++) if (canPlace(slotUsed, j, s, length)) {
-                            day = j;
-                            startSlot = s;
-                            goto found;
-                        }
-                        found:;
+                for (u32 j = 0; j < count; j++) {
+                    const u32 length = courseSlots[sessions[j].first].sessionLengths[sessions[j].second], next = (p + length) << count | placed | 1u << j;
+                    if (placed >> j & 1 || p + length > Slots) continue;
+                    const u16 value = static_cast<u16>(current + startPenalties<Slots>[length][p]);
+                    if (value < cost[next]) {
+                        cost[next] = value;
+                        choice[next] = static_cast<u16>(j);
                     }
+                }
+            }
+            if (starts != nullptr) {
+                starts->assign(count, 0);
+                for (u32 p = Slots, placed = full; p > 0;) {
+                    const u16 j = choice[p << count | placed];
+                    if (j == UINT16_MAX) p--;
                     else {
-                        day = candidates[0].first;
-                        startSlot = candidates[0].second;
-                        for (const auto& [_day, _startSlot] : candidates) if ((_startSlot != 0 && _startSlot != 7) && (startSlot == 0 || startSlot == 7)) {
-                            day = _day;
-                            startSlot = _startSlot;
-                        }
+                        p -= courseSlots[sessions[j].first].sessionLengths[sessions[j].second];
+                        (*starts)[j] = p;
+                        placed &= ~(1u << j);
                     }
-                    if (day >= 5) {
-                        setError("无法为课程 " + courseSlots[i].code + " 安排足够的课时。");
-                        schedules.clear();
-                        return schedules;
+                }
+            }
+            return cost[Slots << count | full];
+        }
+
+        //将安排在 day 的各次课（课程下标与第几次课）收集到 daySessions 中
+        const vector<pair<u32, u32>>& collectDaySessions(const vector<array<u32, 3>>& days, u32 day) noexcept {
+            daySessions.clear();
+            for (u32 i = 0; i < courseSlots.size(); i++) for (u32 session = 0; session < courseSlots[i].sessionsPerWeek; session++) if (days[i][session] == day) daySessions.emplace_back(i, session);
+            return daySessions;
+        }
+
+        void search(u32 penalty) noexcept {
+            if (stopped || penalty >= bestPenalty) return;
+            if (remainingSessions == 0) {
+                for (u32 d = 0; d < Days && penalty < bestPenalty; d++) penalty += arrangeDay(collectDaySessions(sessionDays, d), nullptr);
+                if (penalty < bestPenalty) {
+                    bestPenalty = penalty;
+                    bestDays = sessionDays;
+                }
+                if (bestPenalty == 0 || !options.optimize) stopped = true;
+                return;
+            }
+            if ((options.nodeLimit != 0 && nodes >= options.nodeLimit) || (options.timeLimit != 0 && (nodes & 1023) == 0 && std::chrono::steady_clock::now() >= deadline)) {
+                stopped = true;
+                return;
+            }
+            nodes++;
+            if (options.strictDaySpread && !checkDayCapacity()) return;
+            u32 chosen = UINT32_MAX, chosenDays = 0, chosenCount = UINT32_MAX, chosenLength = 0;
+            for (u32 i = 0; i < courseSlots.size(); i++) {
+                if (nextSession[i] >= courseSlots[i].sessionsPerWeek || (twins[i] != UINT32_MAX && nextSession[twins[i]] == 0)) continue;
+                const u32 days = getDayOptions(i), count = static_cast<u32>(std::popcount(days)), length = courseSlots[i].sessionLengths[nextSession[i]];
+                if (count == 0) return;
+                if (count < chosenCount || (count == chosenCount && length > chosenLength)) {
+                    chosen = i;
+                    chosenDays = days;
+                    chosenCount = count;
+                    chosenLength = length;
+                }
+            }
+            const u32 session = nextSession[chosen], previousBlocked = blockedDays[chosen];
+            //按代价从小到大尝试，同代价时优先空位最少且能放下的日子，使各天尽量装满
+            array<u32, Days> candidates;
+            u32 candidateCount = 0;
+            for (u32 days = chosenDays; days != 0; days &= days - 1) {
+                const u32 day = static_cast<u32>(std::countr_zero(days));
+                candidates[candidateCount++] = ((previousBlocked >> day & 1 ? spreadPenalty : 0) << 16 | (freeSlots[day] - chosenLength)) << 8 | day;
+            }
+            std::sort(candidates.begin(), candidates.begin() + candidateCount);
+            nextSession[chosen]++;
+            remainingSessions--;
+            for (u32 i = 0; i < candidateCount && !stopped; i++) {
+                const u32 day = candidates[i] & 0xFF;
+                sessionDays[chosen][session] = day;
+                freeSlots[day] -= chosenLength;
+                blockedDays[chosen] = getBlockedDays(previousBlocked, day);
+                search(penalty + (candidates[i] >> 24));
+                freeSlots[day] += chosenLength;
+            }
+            blockedDays[chosen] = previousBlocked;
+            remainingSessions++;
+            nextSession[chosen]--;
+        }
+
+      public:
+        [[nodiscard]] explicit ExactPlacer(const vector<CourseSlot>& courseSlots, const PlacementOptions& options) noexcept : courseSlots(courseSlots), options(options) {}
+
+        //找到可行方案时返回 true；exhausted 表示搜索是否在上限之内完整结束（此时失败即说明不存在可行方案）
+        [[nodiscard]] bool solve(BasicSchedule<Days, Slots>& schedule, bool& exhausted) noexcept {
+            const u32 courseCount = static_cast<u32>(courseSlots.size());
+            nextSession.assign(courseCount, 0);
+            blockedDays.assign(courseCount, 0);
+            sessionDays.assign(courseCount, { 0, 0, 0 });
+            twins.assign(courseCount, UINT32_MAX);
+            for (u32 i = 0; i < courseCount; i++) for (u32 j = i; j-- > 0;) if (courseSlots[j].sessionsPerWeek == courseSlots[i].sessionsPerWeek && courseSlots[j].sessionLengths == courseSlots[i].sessionLengths) {
+                twins[i] = j;
+                break;
+            }
+            freeSlots.fill(Slots);
+            nodes = 0;
+            bestPenalty = UINT32_MAX;
+            stopped = false;
+            remainingSessions = 0;
+            u32 totalLength = 0;
+            exhausted = true;
+            for (const CourseSlot& slot : courseSlots) {
+                remainingSessions += slot.sessionsPerWeek;
+                for (u32 i = 0; i < slot.sessionsPerWeek; i++) {
+                    if (slot.sessionLengths[i] > Slots) return false;
+                    totalLength += slot.sessionLengths[i];
+                }
+            }
+            if (totalLength > Days * Slots) return false;
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.timeLimit);
+            search(0);
+            exhausted = !stopped || bestPenalty != UINT32_MAX;
+            Stats::add(Stats::Counter::ExactNodes, nodes);
+            if (bestPenalty == UINT32_MAX) return false;
+            schedule = BasicSchedule<Days, Slots>();
+            vector<u32> starts;
+            for (u32 d = 0; d < Days; d++) {
+                const vector<pair<u32, u32>>& sessions = collectDaySessions(bestDays, d);
+                (void)arrangeDay(sessions, &starts);
+                for (u32 j = 0; j < sessions.size(); j++) {
+                    const CourseSlot& slot = courseSlots[sessions[j].first];
+                    for (u32 k = 0; k < slot.sessionLengths[sessions[j].second]; k++) schedule.slots[d][starts[j] + k] = static_cast<u8>(sessions[j].first);
+                }
+            }
+            return true;
+        }
+    };
+
+    //为一个学期排课，失败时将原因写入 error；courseSlots 仅作为可复用的缓冲区
+    [[nodiscard]] inline bool getSchedule(const vector<Course>& courses, const vector<u32>& arrangement, u64 semesterIdx, const PlacementOptions& options, vector<CourseSlot>& courseSlots, Schedule& schedule, string& error) noexcept {
+        courseSlots.clear();
+        u64 slotUsed = 0;
+        if (arrangement.size() >= Schedule::emptySlot) {
+            error = "第 " + to_string(semesterIdx + 1) + " 学期的课程数量超过了课表的容量。";
+            return false;
+        }
+        for (u64 i = 0; i < arrangement.size(); i++) {
+            if (arrangement[i] >= courses.size()) {
+                error = "无法找到编号 " + to_string(arrangement[i]) + " 对应的课程信息。";
+                return false;
+            }
+            courseSlots.push_back(getCourseSlot(courses, arrangement[i]));
+        }
+        //课时总数与单次课的长度是排课的必要条件，先行检查
+        u32 totalLength = 0;
+        for (const CourseSlot& slot : courseSlots) for (u32 session = 0; session < slot.sessionsPerWeek; session++) {
+            if (slot.sessionLengths[session] > Schedule::slotsPerDay) {
+                error = "第 " + to_string(semesterIdx + 1) + " 学期的课程 " + string(courses[slot.course].code) + " 一次课需要 " + to_string(slot.sessionLengths[session]) + " 节，超过了每天的 " + to_string(Schedule::slotsPerDay) + " 节。";
+                return false;
+            }
+            totalLength += slot.sessionLengths[session];
+        }
+        if (totalLength > Schedule::days * Schedule::slotsPerDay) {
+            error = "第 " + to_string(semesterIdx + 1) + " 学期的课程共需 " + to_string(totalLength) + " 节课，超过了课表的 " + to_string(Schedule::days * Schedule::slotsPerDay) + " 个时段。";
+            return false;
+        }
+        for (u64 i = 0; i < courseSlots.size(); i++) {
+            u32 blockedDays = 0;
+            for (u32 session = 0; session < courseSlots[i].sessionsPerWeek; session++) {
+                u32 length = courseSlots[i].sessionLengths[session], day = 0, startSlot = 0;
+                if (!findPlacement<Schedule::days, Schedule::slotsPerDay>(slotUsed, blockedDays, length, day, startSlot)) {
+                    if (!options.exact) {
+                        error = "无法为课程 " + string(courses[courseSlots[i].course].code) + " 安排足够的课时。";
+                        return false;
                     }
-                    place(schedule, slotUsed, day, startSlot, length, courseSlots[i].name);
-                    usedDays.push_back(day);
+                    bool exhausted;
+                    Stats::add(Stats::Counter::ExactSearches, 1);
+                    if (ExactPlacer<Schedule::days, Schedule::slotsPerDay>(courseSlots, options).solve(schedule, exhausted)) return true;
+                    if (exhausted) error = "第 " + to_string(semesterIdx + 1) + " 学期的课程无法全部排入课表：不存在满足约束的安排。";
+                    else error = "第 " + to_string(semesterIdx + 1) + " 学期的课程无法全部排入课表：在搜索上限内没有找到可行的安排。";
+                    return false;
                 }
+                place(schedule, slotUsed, day, startSlot, length, static_cast<u8>(i));
+                blockedDays = getBlockedDays(blockedDays, day);
             }
-            schedules.push_back(schedule);
         }
-        return schedules;
+        return true;
+    }
+
+    //threadCount 不为 1 时各学期并行排课（0 表示使用硬件并发数），结果仍按学期顺序排列；
+    //并行时会为所有学期排课，并按学期顺序逐行报告每个失败学期的原因
+    [[nodiscard]] inline Result<vector<Schedule>> getSchedules(const vector<Course>& courses, const vector<vector<u32>>& arrangements, const PlacementOptions& options = {}, u32 threadCount = 1) noexcept {
+        if (courses.empty() || arrangements.empty()) return { .error = "数据无效。" };
+        const Stats::Span span(Stats::Phase::Place);
+        Stats::add(Stats::Counter::Semesters, arrangements.size());
+        Result<vector<Schedule>> result;
+        vector<Schedule>& schedules = result.value;
+        schedules.resize(arrangements.size());
+        if (threadCount == 1 || arrangements.size() == 1) {
+            vector<CourseSlot> courseSlots;
+            for (u64 semesterIdx = 0; semesterIdx < arrangements.size(); semesterIdx++) if (!getSchedule(courses, arrangements[semesterIdx], semesterIdx, options, courseSlots, schedules[semesterIdx], result.error)) {
+                schedules.clear();
+                return result;
+            }
+            return result;
+        }
+        vector<string> errors(arrangements.size());
+        Utils::parallelFor(arrangements.size(), threadCount, [&](u64 semesterIdx) noexcept {
+            thread_local vector<CourseSlot> courseSlots;
+            (void)getSchedule(courses, arrangements[semesterIdx], semesterIdx, options, courseSlots, schedules[semesterIdx], errors[semesterIdx]);
+        });
+        for (const string& error : errors) if (!error.empty()) result.error += (result.error.empty() ? "" : "\n") + error;
+        if (!result.error.empty()) schedules.clear();
+        return result;
     }
 }
\ No newline at end of file
@@ -1,25 +1,49 @@
 ﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #if defined(_WIN32) || defined(_WIN64) || defined(__WIN32__) || defined(__NT__)
     #define _TOPOSORT_WINDOWS 1
     #include <windows.h> // IWYU pragma: keep
 #else
     #define _TOPOSORT_UNIX 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
     #include <unistd.h> // IWYU pragma: keep
 #endif
 
 namespace Toposort::Utils {
-    using std::string, std::filesystem::path, std::error_code, std::cout, std::endl;
+    typedef uint32_t u32;
+    typedef uint64_t u64;
+    using std::string, std::string_view, std::vector, std::filesystem::path, std::error_code, std::ifstream, std::from_chars, std::errc, std::cout, std::endl;
 
     #define STR(p) reinterpret_cast<const char*>(p.u8string().c_str())
 
-    inline string errorMessage;
+    //各阶段的返回值，error 非空时表示失败，此时 value 不应被使用
+    template<typename T> struct Result {
+        T value{};
+        string error;
 
-    [[nodiscard]] inline string getLastError() noexcept { return errorMessage; }
-    inline void setError(const string& err) noexcept { errorMessage = err; }
+        [[nodiscard]] bool ok() const noexcept { return error.empty(); }
+    };
 
     inline bool normalize(path& p) noexcept {
         error_code ec;
@@ -29,4 +53,273 @@ namespace Toposort::Utils {
         p.make_preferred();
         return true;
     }
+
+    //只读方式映射整个文件；无法映射时（例如管道或空文件）退回到分块读取到内存
+    class MappedFile {
+        const char* data = nullptr;
+        u64 size = 0;
+        string buffer;
+        void* mapping = nullptr;
+        #if _TOPOSORT_WINDOWS
+            HANDLE fileHandle = INVALID_HANDLE_VALUE, mappingHandle = nullptr;
+        #endif
+
+        [[nodiscard]] bool tryMap(const path& filePath) noexcept {
+            #if _TOPOSORT_WINDOWS
+                fileHandle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+                if (fileHandle == INVALID_HANDLE_VALUE) return false;
+                LARGE_INTEGER fileSize;
+                if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart <= 0) return false;
+                mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mappingHandle == nullptr) return false;
+                void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+                if (view == nullptr) return false;
+                mapping = view;
+                data = static_cast<const char*>(view);
+                size = static_cast<u64>(fileSize.QuadPart);
+            #else
+                //先按路径检查，避免打开管道等特殊文件后再关闭导致数据丢失
+                struct stat fileStat;
+                if (stat(filePath.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || fileStat.st_size <= 0) return false;
+                const int fd = ::open(filePath.c_str(), O_RDONLY);
+                if (fd < 0) return false;
+                if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+                    ::close(fd);
+                    return false;
+                }
+                void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (view == MAP_FAILED) return false;
+                madvise(view, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+                mapping = view;
+                data = static_cast<const char*>(view);
+                size = static_cast<u64>(fileStat.st_size);
+            #endif
+            return true;
+        }
+
+        void unmap() noexcept {
+            #if _TOPOSORT_WINDOWS
+                if (mapping != nullptr) UnmapViewOfFile(mapping);
+                if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+                if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+                mappingHandle = nullptr;
+                fileHandle = INVALID_HANDLE_VALUE;
+            #else
+                if (mapping != nullptr) munmap(mapping, size);
+            #endif
+            mapping = nullptr;
+            data = nullptr;
+            size = 0;
+        }
+
+      public:
+        [[nodiscard]] explicit MappedFile() noexcept = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() noexcept { unmap(); }
+
+        [[nodiscard]] bool open(const path& filePath) noexcept {
+            unmap();
+            buffer.clear();
+            if (tryMap(filePath)) return true;
+            unmap();
+            ifstream file(filePath, std::ios::in | std::ios::binary);
+            if (!file.is_open()) return false;
+            constexpr u64 chunkSize = 1 << 16;
+            u64 length = 0;
+            while (file) {
+                buffer.resize(length + chunkSize);
+                file.read(buffer.data() + length, chunkSize);
+                length += static_cast<u64>(file.gcount());
+            }
+            buffer.resize(length);
+            data = buffer.data();
+            size = length;
+            return true;
+        }
+
+        [[nodiscard]] string_view view() const noexcept { return string_view(data, size); }
+    };
+
+    //取出下一个以 delimiter 分隔的字段，行为与 getline 一致：没有剩余字符时返回 false
+    [[nodiscard]] inline bool nextField(string_view text, u64& pos, char delimiter, string_view& field) noexcept {
+        if (pos >= text.size()) return false;
+        const u64 end = text.find(delimiter, pos);
+        if (end == string_view::npos) {
+            field = text.substr(pos);
+            pos = text.size();
+        }
+        else {
+            field = text.substr(pos, end - pos);
+            pos = end + 1;
+        }
+        return true;
+    }
+
+    //与 stoul 一致：跳过前导空白，允许正号，忽略数字之后的字符
+    [[nodiscard]] inline bool parseU32(string_view text, u32& value) noexcept {
+        u64 i = 0;
+        while (i < text.size() && (text[i] == ' ' || (text[i] >= '\t' && text[i] <= '\r'))) i++;
+        if (i < text.size() && text[i] == '+') i++;
+        const auto [ptr, ec] = from_chars(text.data() + i, text.data() + text.size(), value);
+        return ec == errc();
+    }
+
+    //用 threadCount 个线程（0 表示硬件并发数）执行 task(0) 到 task(count - 1)，各线程通过原子计数器领取下标，
+    //当前线程也参与执行；无法创建更多线程时由已有的线程完成剩余任务
+    template<typename Task> inline void parallelFor(u64 count, u32 threadCount, const Task& task) noexcept {
+        if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+        if (threadCount > count) threadCount = static_cast<u32>(count);
+        std::atomic<u64> next = 0;
+        const auto work = [&]() noexcept {
+            for (u64 i = next.fetch_add(1, std::memory_order_relaxed); i < count; i = next.fetch_add(1, std::memory_order_relaxed)) task(i);
+        };
+        vector<std::thread> workers;
+        for (u32 i = 1; i < threadCount; i++) {
+            try { workers.emplace_back(work); } catch (...) { break; }
+        }
+        work();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    //有界阻塞队列：队列满时 push 等待，close 之后 push 失败，pop 取完剩余元素后返回 false
+    template<typename T> class BoundedQueue {
+        std::mutex mutex;
+        std::condition_variable notEmpty, notFull;
+        std::deque<T> items;
+        u64 capacity;
+        bool closed = false;
+
+    public:
+        [[nodiscard]] explicit BoundedQueue(u64 capacity) noexcept : capacity(std::max<u64>(capacity, 1)) {}
+
+        [[nodiscard]] bool push(T item) noexcept {
+            std::unique_lock lock(mutex);
+            notFull.wait(lock, [&] { return closed || items.size() < capacity; });
+            if (closed) return false;
+            items.push_back(std::move(item));
+            lock.unlock();
+            notEmpty.notify_one();
+            return true;
+        }
+
+        [[nodiscard]] bool pop(T& item) noexcept {
+            std::unique_lock lock(mutex);
+            notEmpty.wait(lock, [&] { return closed || !items.empty(); });
+            if (items.empty()) return false;
+            item = std::move(items.front());
+            items.pop_front();
+            lock.unlock();
+            notFull.notify_one();
+            return true;
+        }
+
+        void close() noexcept {
+            {
+                const std::lock_guard lock(mutex);
+                closed = true;
+            }
+            notEmpty.notify_all();
+            notFull.notify_all();
+        }
+    };
+
+    //只追加的字符串池：存入的文本在池销毁前地址不变，课程代码、名称等以 string_view 指向池中的内容。
+    //同一份培养方案的各个副本共享一个池，存入时加锁，可以在多个线程中同时进行；
+    //副本需要存入新文本而不影响原方案时，另建一个以原池为 base 的池，base 中的文本随之保持有效
+    class StringPool {
+        static constexpr u64 blockSize = 1 << 16;
+        std::shared_ptr<const StringPool> base;
+        std::mutex mutex;
+        vector<std::unique_ptr<char[]>> blocks;
+        char* cursor = nullptr;
+        u64 remaining = 0;
+
+    public:
+        [[nodiscard]] explicit StringPool(std::shared_ptr<const StringPool> base = nullptr) noexcept : base(std::move(base)) {}
+
+        [[nodiscard]] string_view store(string_view text) noexcept {
+            if (text.empty()) return {};
+            const std::lock_guard lock(mutex);
+            //较长的文本（例如整个输入文件）单独占一块，不浪费当前块的剩余空间
+            if (text.size() > blockSize / 4) {
+                char* block = blocks.emplace_back(new char[text.size()]).get();
+                std::memcpy(block, text.data(), text.size());
+                return string_view(block, text.size());
+            }
+            if (text.size() > remaining) {
+                cursor = blocks.emplace_back(new char[blockSize]).get();
+                remaining = blockSize;
+            }
+            std::memcpy(cursor, text.data(), text.size());
+            const string_view stored(cursor, text.size());
+            cursor += text.size();
+            remaining -= text.size();
+            return stored;
+        }
+    };
+
+    //每个线程一块可复用的临时内存。Scope 存在期间，临时容器通过 resource() 从单调分配器取内存，
+    //最外层的 Scope 结束时整体归还；缓冲区按以往的最大用量增长（最多保留 maxCapacity），之后的运行不再向系统申请内存
+    class ScratchArena {
+        //单个线程保留的缓冲区上限，更大的用量超出部分每次向系统申请
+        static constexpr u64 maxCapacity = 1 << 26;
+
+        //统计缓冲区用尽后向系统申请的字节数
+        class Upstream final : public std::pmr::memory_resource {
+            void* do_allocate(size_t bytes, size_t alignment) override {
+                overflow += bytes;
+                return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            }
+
+            void do_deallocate(void* p, size_t bytes, size_t alignment) override { std::pmr::new_delete_resource()->deallocate(p, bytes, alignment); }
+
+            [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+        public:
+            u64 overflow = 0;
+        };
+
+        std::unique_ptr<std::byte[]> buffer;
+        u64 capacity = 0;
+        u32 depth = 0;
+        Upstream upstream;
+        std::optional<std::pmr::monotonic_buffer_resource> resource;
+
+        [[nodiscard]] static ScratchArena& local() noexcept {
+            thread_local ScratchArena arena;
+            return arena;
+        }
+
+    public:
+        class Scope {
+            ScratchArena& arena;
+
+        public:
+            [[nodiscard]] explicit Scope() noexcept : arena(local()) {
+                if (arena.depth++ > 0) return;
+                arena.upstream.overflow = 0;
+                if (arena.capacity == 0) arena.resource.emplace(&arena.upstream);
+                else arena.resource.emplace(arena.buffer.get(), arena.capacity, &arena.upstream);
+            }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            ~Scope() noexcept {
+                if (--arena.depth > 0) return;
+                arena.resource.reset();
+                const u64 capacity = std::min(arena.capacity + arena.upstream.overflow, maxCapacity);
+                if (capacity <= arena.capacity) return;
+                //申请失败时保留原来的缓冲区
+                std::byte* grown = new (std::nothrow) std::byte[capacity];
+                if (grown == nullptr) return;
+                arena.buffer.reset(grown);
+                arena.capacity = capacity;
+            }
+
+            [[nodiscard]] std::pmr::memory_resource* resource() const noexcept { return &*arena.resource; }
+        };
+    };
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+﻿#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "generator.hpp"
+#include "snapshot.hpp"
+#include "toposort.hpp"
+
+namespace Toposort::Tests {
+    typedef uint32_t u32;
+    typedef uint64_t u64;
+    using std::string, std::vector;
+
+    //快照还原出的培养方案必须与解析文本得到的完全相同
+    [[nodiscard]] inline bool checkRoundTrip(const Curriculum& parsed, const Curriculum& restored, string& error) noexcept {
+        if (restored.semesterLimits != parsed.semesterLimits) error = "学期课程数上限不同。";
+        else if (restored.courses.size() != parsed.courses.size()) error = "课程数不同。";
+        else if (restored.graph.offsets != parsed.graph.offsets || restored.graph.dependents != parsed.graph.dependents || restored.graph.inDegree != parsed.graph.inDegree || restored.graph.danglingReferences != parsed.graph.danglingReferences) error = "先修关系图不同。";
+        for (u64 i = 0; error.empty() && i < parsed.courses.size(); i++) {
+            const Course &a = parsed.courses[i], &b = restored.courses[i];
+            if (a.code != b.code || a.name != b.name || a.credit != b.credit || a.semester != b.semester || a.prerequisites != b.prerequisites) error = "第 " + std::to_string(i + 1) + " 门课程不同。";
+        }
+        return error.empty();
+    }
+
+    //损坏的快照必须被拒绝而不能越界读取：截断的文件、各项长度之和会溢出的文件头、学期课程数之和与课程数不符
+    [[nodiscard]] inline bool checkCorruptSnapshots(const string& snapshot, string& error) noexcept {
+        vector<string> corrupted;
+        for (const u64 size : { u64(0), sizeof(SnapshotHeader) - 1, sizeof(SnapshotHeader), snapshot.size() / 2, snapshot.size() - 1 }) corrupted.push_back(snapshot.substr(0, size));
+        SnapshotHeader header;
+        std::memcpy(&header, snapshot.data(), sizeof(header));
+        header.courseCount += 1000000;
+        const u64 words = u64(header.semesterCount) + 7ull * header.courseCount + 2 + header.prerequisiteCount + header.edgeCount + 2ull * header.danglingCount + header.stringCount + 1ull;
+        header.stringBytes = snapshot.size() - sizeof(SnapshotHeader) - words * sizeof(u32);
+        string& overflow = corrupted.emplace_back(snapshot);
+        std::memcpy(overflow.data(), &header, sizeof(header));
+        string& limits = corrupted.emplace_back(snapshot);
+        limits[sizeof(SnapshotHeader)]++;
+        for (u64 i = 0; i < corrupted.size(); i++) if (readSnapshot(corrupted[i]).ok()) {
+            error = "第 " + std::to_string(i + 1) + " 个损坏的快照没有被拒绝。";
+            return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] inline bool checkContent(const string& content, string& error) noexcept {
+        const Result<Curriculum> parsed = parseCurriculum(content);
+        if (!parsed.ok()) {
+            error = parsed.error;
+            return false;
+        }
+        string snapshot;
+        writeSnapshot(snapshot, parsed.value, hashContent(content), content.size());
+        const Result<Curriculum> restored = readSnapshot(snapshot);
+        if (!restored.ok()) {
+            error = restored.error;
+            return false;
+        }
+        return checkRoundTrip(parsed.value, restored.value, error) && checkCorruptSnapshots(snapshot, error);
+    }
+}
+
+int main() {
+    using std::string, std::cerr, std::endl, Toposort::Bench::GeneratorOptions;
+
+    //含有找不到的先修课程与空学期的小方案，以及不同规模的生成方案
+    const string dangling = "2 0 1 1\r\nA,甲,3,0,Z\r\nB,乙,2,0,\r\nC,丙,2,0,A;Z\r\nD,丁,2,0,\r\n";
+    string error;
+    if (!Toposort::Tests::checkContent(dangling, error)) {
+        cerr << "错误：小方案：" << error << endl;
+        return 1;
+    }
+    for (const uint32_t courses : { 100u, 1000u, 10000u }) {
+        GeneratorOptions options;
+        options.courses = courses;
+        if (!Toposort::Tests::checkContent(Toposort::Bench::generateCurriculum(options), error)) {
+            cerr << "错误：" << courses << " 门课程：" << error << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
\ No newline at end of file